@@ -58,6 +58,7 @@ parser.set_defaults(
   allow_reflection=False,
   alignment_steps=8,
   max_iterations=10,
+  online=False,
   destination='.'
 )
 parser.add_option('-q', '--quiet', action='store_false', dest='show_progress',
@@ -68,6 +69,8 @@ parser.add_option('-s', '--alignment-steps', type='int', metavar='STEPS',
   help='number of candidate point orderings to try for each shape during global alignment [default: %default]')
 parser.add_option('-m', '--max-iterations', type='int', metavar='ITERS',
   help='maximum number of iterations for mutual contour alignment [default: %default]')
+parser.add_option('-o', '--online', action='store_true', dest='online',
+  help='update the mean contour after each contour is aligned, rather than once per iteration (usually converges faster)')
 parser.add_option('-r', '--reference', metavar='CONTOUR',
   help='reference contour file that other contours will be aligned to (if not specified, contours will be mutually aligned)')
 parser.add_option('-d', '--destination', metavar='DIRECTORY',
@@ -87,7 +90,7 @@ def main(name, arguments):
       allow_reflection=options.allow_reflection, show_progress=options.show_progress)
   else:
     contours = simple_interface.align_contours(contours, options.alignment_steps, options.allow_reflection,
-      max_iters=options.max_iterations, show_progress = options.show_progress)
+      max_iters=options.max_iterations, show_progress = options.show_progress, online = options.online)
   destination = path.path(options.destination)
   if not destination.exists():
     destination.makedirs()
@@ -30,6 +30,9 @@ This tool can guess these endpoint locations in several different ways:
       the contour bends inward most sharply (subject to the constraint that
       the positions selected are separated by at least 1/3 the distance of
       the contour). ("curvature" method)
+  (5) The longest path through the medial axis (skeleton) of the contour can
+      be used directly as the initial center-line, which then needs only a
+      single round of optimization. ("medial" method)
 
 The best choice is strongly dependent on the specific shapes under
 consideration. In general, the default "horizontal" method is a good choice
@@ -58,12 +61,14 @@ parser.add_option('-q', '--quiet', action='store_false', dest='show_progress',
 parser.add_option('-p', '--axis-points', type='int', metavar='POINTS',
   help='number of points to calculate along the central axis [default: %default]')
 parser.add_option('-m', '--endpoint-method', type='choice', metavar='METHOD',
-  choices=['horizontal', 'vertical', 'distance', 'curvature'],
+  choices=['horizontal', 'vertical', 'distance', 'curvature', 'medial'],
   help='method to use to guess the location of the center-line endpoints [default "%default"] (not used if endpoints are specified directly with the --endpoints option)')
 parser.add_option('-e', '--endpoints', type='float', nargs=2, metavar='POSITION',
   help='starting and ending vertex numbers (two numbers must be specified)')
 parser.add_option('-d', '--destination', metavar='DIRECTORY',
   help='directory in which to write the output contours [default: %default]')
+parser.add_option('--threads', type='int', metavar='THREADS',
+  help='number of contours to process in parallel [default: one per processor]')
 
 def main(name, arguments):
   parser.prog = name
@@ -77,7 +82,8 @@ def main(name, arguments):
     endpoints = options.endpoint_method
   else:
     endpoints = options.endpoints
-  contours = simple_interface.find_centerlines(contours, options.axis_points, endpoints, options.show_progress)
+  contours = simple_interface.find_centerlines(contours, options.axis_points, endpoints,
+    options.show_progress, options.threads)
   destination = path.path(options.destination)
   if not destination.exists():
     destination.makedirs()
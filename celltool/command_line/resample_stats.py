@@ -77,6 +77,10 @@ parser.add_option('-r', '--reference', action='append',
   help='make the following data file one of the references [default: no references means all-pairs mode is used]')
 parser.add_option('-o', '--output-file', metavar='FILE',
   help='CSV file to write [default: %default]')
+parser.add_option('-s', '--seed', type='int', metavar='SEED',
+  help='seed for the random number generator, to make the resampling reproducible [default: a random seed]')
+parser.add_option('--threads', type='int', metavar='THREADS',
+  help='number of threads to use for resampling [default: one per processor]')
 
 def main(name, arguments):
   parser.prog = name
@@ -107,7 +111,7 @@ def main(name, arguments):
   if options.show_progress:
     pb = terminal_tools.IndeterminantProgressBar("Resampling data")
   if len(ref_pops) > 0:
-    pvals = ks_resample.compare_to_ref(pops, ref_pops, options.n)
+    pvals = ks_resample.compare_to_ref(pops, ref_pops, options.n, options.seed, options.threads)
     if len(ref_names) > 1:
       ref_name = 'reference (%s)' %(', '.join(ref_names))
     else:
@@ -116,7 +120,7 @@ def main(name, arguments):
     for name, p in zip(names, pvals):
       rows.append([name, format_pval(p, options.n)])
   else: # no ref pops
-    pvals = ks_resample.symmetric_comparison(pops, options.n)
+    pvals = ks_resample.symmetric_comparison(pops, options.n, options.seed, options.threads)
     rows = [[None] + names]
     for i, (name, p_row) in enumerate(zip(names, pvals)):
       rows.append([name] + [format_pval(p, options.n) for p in p_row])
@@ -48,6 +48,8 @@ parser.set_defaults(
   variance_explained=0.95,
   output_prefix='shape-model',
   write_data=True,
+  randomized=False,
+  streaming=False
 )
 parser.add_option('-q', '--quiet', action='store_false', dest='show_progress',
   help='suppress progress bars and other status updates')
@@ -55,6 +57,10 @@ parser.add_option('-v', '--variance-explained', type='float',
   help='minimum fraction of total variance explained by the recorded shape modes [default: %default]')
 parser.add_option('-n', '--no-data', action='store_false', dest='write_data',
   help='do not write out the positions and normalized positions of the contours')
+parser.add_option('-r', '--randomized', action='store_true', dest='randomized',
+  help='calculate only the required shape modes with a fast randomized algorithm (useful for very large data sets)')
+parser.add_option('-s', '--streaming', action='store_true', dest='streaming',
+  help='do not load all contours into memory at once (for data sets too large to fit in memory); cannot be combined with --randomized')
 parser.add_option('-o', '--output-prefix', 
   help='directory and file name prefix for shape model and data files written [default: %default]')
 
@@ -64,8 +70,15 @@ def main(name, arguments):
   args = cli_tools.glob_args(args)
   if len(args) == 0:
     raise ValueError('Some contour files must be specified!')
-  contours = simple_interface.load_contours(args, show_progress = options.show_progress)
-  shape_model, header, rows, norm_header, norm_rows = simple_interface.make_shape_model(contours, options.variance_explained)
+  if options.streaming and options.randomized:
+    parser.error('the --streaming and --randomized options cannot be used together.')
+  if options.streaming:
+    shape_model, header, rows, norm_header, norm_rows = simple_interface.make_shape_model_from_files(args,
+      options.variance_explained, show_progress = options.show_progress)
+  else:
+    contours = simple_interface.load_contours(args, show_progress = options.show_progress)
+    shape_model, header, rows, norm_header, norm_rows = simple_interface.make_shape_model(contours, options.variance_explained,
+      options.randomized)
   shape_model.to_file(options.output_prefix + '.contour')
   if options.write_data:
     datafile.write_data_file([header]+rows, options.output_prefix + '-positions.csv')
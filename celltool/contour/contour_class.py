@@ -288,12 +288,57 @@ class Contour(PointSet):
 
   Please also review the PointSet documentation for relevant details, especially
   pertaining to the __init__ method and method with 'as_' names.
+
+  Derived geometry that is expensive to compute (the interpolating spline,
+  its derivatives, the inter-point distances, etc.) is cached, so that
+  repeated measurements of the same contour do not re-fit the spline each
+  time. Assigning to the 'points' attribute clears this cache, and the
+  transform, offset_points, and reverse_orientation methods update the cached
+  values directly where possible. Code which modifies the points array IN
+  PLACE must call clear_cache() afterward.
   """
   _instance_data = dict(PointSet._instance_data)
 
   def __init__(self, **kws):
     PointSet.__init__(self, **kws)
     self._make_acyclic()
+    other = kws.get('other')
+    if 'points' not in kws and isinstance(other, Contour) and other.points.shape == self.points.shape:
+      # copy-construction: the points are the same, so the derived data are too.
+      self._derived = dict(other._derived)
+
+  def _get_points(self):
+    return self._points
+
+  def _set_points(self, points):
+    self._points = points
+    self._derived = {}
+
+  points = property(_get_points, _set_points, doc='Nx2 array of (x, y) contour points.')
+
+  def clear_cache(self):
+    """Discard all cached derived geometry. This is only necessary if the
+    points array has been modified in place; assigning a new array to the
+    'points' attribute does this automatically."""
+    self._derived = {}
+
+  def _cached(self, key, function, *args):
+    """Return the cached value stored under 'key', or call function(*args) to
+    calculate and store that value if it is not present."""
+    try:
+      return self._derived[key]
+    except KeyError:
+      value = self._derived[key] = function(*args)
+      return value
+
+  def bounding_box(self):
+    return numpy.array(self._cached('bounding_box', PointSet.bounding_box, self), copy=True)
+  bounding_box.__doc__ = PointSet.bounding_box.__doc__
+
+  def size(self):
+    mins, maxes = self._cached('bounding_box', PointSet.bounding_box, self)
+    return maxes - mins
+  size.__doc__ = PointSet.size.__doc__
 
   def area(self):
     """Return the area inside of the contour."""
@@ -304,15 +349,26 @@ class Contour(PointSet):
 
     If the contour points wind counter-clockwise, the area is negative; otherwise
     it is positive."""
+    return self._cached('signed_area', self._signed_area)
+
+  def _signed_area(self):
     xs = self.points[:,0]
     ys = self.points[:,1]
     y_forward = numpy.roll(ys, -1, axis = 0)
     y_backward = numpy.roll(ys, 1, axis = 0)
     return numpy.sum(xs * (y_backward - y_forward)) / 2.0
 
+  def transform(self, transform):
+    derived = self._derived
+    PointSet.transform(self, transform)
+    self._derived = _transform_derived(derived, numpy.asarray(transform, dtype=float))
+  transform.__doc__ = PointSet.transform.__doc__
+
   def reverse_orientation(self):
     """Reverse the orientation of the contour from clockwise to counter-clockwise or vice-versa."""
+    derived = self._derived
     self.points = numpy.flipud(self.points)
+    self._derived = _reverse_derived(derived)
 
   def point_range(self, begin = None, end = None):
     """Get a periodic slice of the contour points from begin to end, inclusive.
@@ -332,26 +388,35 @@ class Contour(PointSet):
 
   def interpoint_distances(self, begin = None, end = None):
     """Calculate the distance from each point to the previous point, optionally over only the periodic slice specified by 'begin' and 'end'."""
+    distances = self._cached('interpoint_distances', self._interpoint_distances)
+    return numpy.array(utility_tools.inclusive_periodic_slice(distances, begin, end), copy=True)
+
+  def _interpoint_distances(self):
     offsetcontour = numpy.roll(self.points, 1, axis = 0)
-    return utility_tools.inclusive_periodic_slice(utility_tools.norm(self.points - offsetcontour, axis = 0), begin, end)
+    return utility_tools.norm(self.points - offsetcontour, axis = 0)
 
   def spline_derivatives(self, begin, end, derivatives=1):
     """Calculate derivative or derivatives of the contour using a spline fit,
     optionally over only the periodic slice specified by 'begin' and 'end'."""
-    import celltool.numerics.fitpack as fitpack
     try:
       l = len(derivatives)
       unpack = False
     except:
       unpack = True
       derivatives = [derivatives]
-    tck, uout = self.to_spline()
-    points = utility_tools.inclusive_periodic_slice(range(len(self.points)), begin, end)
-    ret = [numpy.transpose(fitpack.splev(points, tck, der=d)) for d in derivatives]
+    ret = []
+    for d in derivatives:
+      derivative = self._cached(('derivative', d), self._spline_derivative, d)
+      ret.append(numpy.array(utility_tools.inclusive_periodic_slice(derivative, begin, end), copy=True))
     if unpack:
       ret = ret[0]
     return ret
 
+  def _spline_derivative(self, derivative):
+    import celltool.numerics.fitpack as fitpack
+    tck, uout = self.to_spline()
+    return numpy.transpose(fitpack.splev(numpy.arange(len(self.points)), tck, der=derivative))
+
   def first_derivatives(self, begin = None, end = None):
     """Calculate the first derivatives of the contour, optionally over only the periodic slice specified by 'begin' and 'end'."""
     return self.spline_derivatives(begin, end, 1)
@@ -362,7 +427,11 @@ class Contour(PointSet):
 
   def curvatures(self, begin = None, end = None):
     """Calculate the curvatures of the contour (1/r of the osculating circle at each point), optionally over only the periodic slice specified by 'begin' and 'end'."""
-    d1, d2 = self.spline_derivatives(begin, end, [1,2])
+    curvatures = self._cached('curvatures', self._curvatures)
+    return numpy.array(utility_tools.inclusive_periodic_slice(curvatures, begin, end), copy=True)
+
+  def _curvatures(self):
+    d1, d2 = self.spline_derivatives(None, None, [1,2])
     x1 = d1[:,0]
     y1 = d1[:,1]
     x2 = d2[:,0]
@@ -381,12 +450,17 @@ class Contour(PointSet):
     positions variable (of all points, if not specified). Note that fractional
     positions are acceptable, as these values are calculated via spline
     interpolation."""
+    if positions is None:
+      return numpy.array(self._cached('inward_normals', self._inward_normals, None), copy=True)
+    return self._inward_normals(positions)
+
+  def _inward_normals(self, positions):
     import celltool.numerics.fitpack as fitpack
     if positions is None:
-      positions = numpy.arange(len(self.points))
-    tck, uout = self.to_spline()
-    points = numpy.transpose(fitpack.splev(positions, tck))
-    first_der = numpy.transpose(fitpack.splev(positions, tck, 1))
+      first_der = self.spline_derivatives(None, None, 1)
+    else:
+      tck, uout = self.to_spline()
+      first_der = numpy.transpose(fitpack.splev(positions, tck, 1))
     inward_normals = numpy.empty_like(first_der)
     inward_normals[:,0] = -first_der[:,1]
     inward_normals[:,1] = first_der[:,0]
@@ -419,7 +493,9 @@ class Contour(PointSet):
     the old points[-1] is at points[0], and so forth. This doesn't change the spatial
     position of the contour, but it changes how the points are numbered.
     """
+    derived = self._derived
     self.points = numpy.roll(self.points, offset, axis = 0)
+    self._derived = _offset_derived(derived, offset)
 
   def to_spline(self, smoothing = 0, spacing_corrected = False):
     """Return the best-fit periodic parametric 3rd degree b-spline to the data points.
@@ -442,7 +518,15 @@ class Contour(PointSet):
     the spline. This 'tck' tuple can be used by the routines in celltool.numerics.fitpack,
     or scipy.fitpack if scipy is installed. 'u' is a list of the parameter values
     corresponding to the points in the range.
+
+    The default (interpolating, uniformly-parameterized) spline is cached, so
+    the returned values should not be modified in place.
     """
+    if smoothing == 0 and not spacing_corrected:
+      return self._cached('spline', self._to_spline, 0, False)
+    return self._to_spline(smoothing, spacing_corrected)
+
+  def _to_spline(self, smoothing, spacing_corrected):
     import celltool.numerics.fitpack as fitpack
     # the fitpack smoothing parameter is an upper-bound on the TOTAL squared deviation;
     # ours is a bound on the MEAN squared deviation. Fix the mismatch:
@@ -886,7 +970,8 @@ class PCAContour(Contour):
   _instance_data.update({'mean':numpy.zeros((0, 2)), 'modes':numpy.zeros((0, 0, 2)),
      'standard_deviations':numpy.zeros(0), 'total_variance':0, 'position':numpy.zeros(0)})
 
-  def from_contours(cls, contours, required_variance_explained = 0.95, return_positions = False):
+  def from_contours(cls, contours, required_variance_explained = 0.95, return_positions = False,
+      randomized = False):
     """This class method should be used to construct a PCAContour object from a
     set of contours. The proncipal components of the contours are caltulated, and
     enough retained to account for the 'required_variance_explained' fraction.
@@ -901,6 +986,11 @@ class PCAContour(Contour):
     PCAContour instance, 'positions' is the position of each of the input contours
     along each principal shape mode, and 'normalized_positions' is the position
     along each mode in terms of standard deviations along that mode.
+
+    If 'randomized' is true, only the retained modes are calculated, with a
+    randomized algorithm (see pca.randomized_pca_dimensionality_reduce). This
+    is much faster for large numbers of contours or contour points, and gives
+    nearly identical results.
     """
     import celltool.numerics.pca as pca
     data = [c.points for c in contours]
@@ -915,7 +1005,11 @@ class PCAContour(Contour):
       transform = utility_tools.make_homogenous_transform(transform=scales[0])
     else:
       transform = numpy.eye(3)
-    vals = pca.pca_dimensionality_reduce(numpy.array(data, dtype=numpy.float32), required_variance_explained)
+    if randomized:
+      reduce = pca.randomized_pca_dimensionality_reduce
+    else:
+      reduce = pca.pca_dimensionality_reduce
+    vals = reduce(numpy.array(data, dtype=numpy.float32), required_variance_explained)
     mean, pcs, norm_pcs, variances, total_variance, positions, norm_positions = vals
     c = cls(points=mean, mean=mean, modes=pcs, standard_deviations=numpy.sqrt(variances),
       total_variance=total_variance, position=numpy.zeros(len(norm_pcs)), units=units,
@@ -926,6 +1020,58 @@ class PCAContour(Contour):
       return c
   from_contours = classmethod(from_contours)
 
+  def from_contour_stream(cls, contours, required_variance_explained = 0.95, chunk_size = 1000):
+    """Construct a PCAContour from a (possibly very large) sequence of contours,
+    as with from_contours, but without holding all of the contours in memory.
+
+    The 'contours' parameter can be any iterable, such as a generator that
+    loads contours from disk one at a time. The contours are consumed in
+    chunks of 'chunk_size', from which the mean and covariance of the contour
+    points are accumulated (see pca.CovarianceAccumulator); memory use thus
+    depends only on the chunk size and the number of contour points. The
+    positions of the contours along the shape modes are not returned, as
+    these require a second pass over the data; use find_position for this.
+    """
+    import celltool.numerics.pca as pca
+    accumulator = pca.CovarianceAccumulator()
+    first = True
+    units = None
+    scale = None
+    scales_match = True
+    chunk = []
+    contours = iter(contours)
+    while True:
+      try:
+        contour = contours.next()
+      except StopIteration:
+        contour = None
+      if contour is not None:
+        if first:
+          first = False
+          units = contour.units
+          scale = utility_tools.decompose_homogenous_transform(contour.to_world_transform)[1]
+        elif contour.units != units:
+          raise ValueError('All contours must have the same units in order to produce a PCA shape model from them.')
+        elif scales_match:
+          scales_match = numpy.allclose(scale, utility_tools.decompose_homogenous_transform(contour.to_world_transform)[1])
+        if chunk and contour.points.shape != chunk[0].shape:
+          raise ValueError('All contours must have the same number of points in order to perform PCA.')
+        chunk.append(contour.points)
+      if len(chunk) == chunk_size or (contour is None and chunk):
+        accumulator.add(numpy.array(chunk, dtype=numpy.float32))
+        chunk = []
+      if contour is None:
+        break
+    if scales_match and not first:
+      transform = utility_tools.make_homogenous_transform(transform=scale)
+    else:
+      transform = numpy.eye(3)
+    mean, pcs, norm_pcs, variances, total_variance = accumulator.pca_dimensionality_reduce(required_variance_explained)
+    return cls(points=mean, mean=mean, modes=pcs, standard_deviations=numpy.sqrt(variances),
+      total_variance=total_variance, position=numpy.zeros(len(norm_pcs)), units=units,
+      to_world_transform=transform)
+  from_contour_stream = classmethod(from_contour_stream)
+
   def points_at_position(self, position, normalized = True):
     """Return the shape at a particular position along the principal shape modes.
 
@@ -942,6 +1088,21 @@ class PCAContour(Contour):
     offsets = position[:, numpy.newaxis, numpy.newaxis] * self.modes
     return self.mean + offsets.sum(axis = 0)
 
+  def points_at_positions(self, positions, normalized = True, dtype = None):
+    """Return the shapes at many positions along the principal shape modes.
+
+    The 'positions' parameter should be an array of shape (n, modes), one row
+    for each shape. An array of shape (n, points, 2) containing the points of
+    each shape is returned, calculated with a single matrix multiply. The
+    'normalized' parameter is as in points_at_position. If 'dtype' is given
+    (e.g. numpy.float32), the calculation is done with that precision.
+    """
+    import celltool.numerics.pca as pca
+    positions = numpy.asarray(positions)
+    if normalized:
+      positions = positions * self.standard_deviations
+    return pca.pca_reconstruct(positions, self.modes, self.mean, dtype)
+
   def set_position(self, position, normalized = True):
     """Set the 'points' instance variable to contain the shape at a specified
     position in PCA shape space. See the documentation for points_at_position
@@ -963,6 +1124,26 @@ class PCAContour(Contour):
       position /= self.standard_deviations
     return position
 
+  def find_positions(self, contours, dtype = None):
+    """Find the positions of many contours in the PCA shape space at once.
+
+    The 'contours' parameter may be a list of contour objects, or an array of
+    shape (n, points, 2) containing the points of n contours. The positions
+    are calculated with a single matrix multiply (per block of contours; see
+    pca.pca_decompose). If 'dtype' is given (e.g. numpy.float32), the
+    calculation is done with that precision.
+
+    Returns (positions, normalized_positions), both of shape (n, modes); the
+    normalized positions are in terms of standard deviations along the shape
+    axes.
+    """
+    import celltool.numerics.pca as pca
+    if not isinstance(contours, numpy.ndarray):
+      contours = numpy.array([c.points for c in contours], dtype = dtype)
+    if contours.shape[1:] != self.mean.shape:
+      raise ValueError('Contours must have the same number of points as the shape model.')
+    return pca.pca_decompose(contours, self.modes, self.mean, self.standard_deviations**2, dtype)
+
   def transform(self, transform):
     """Transform the data points with the provided affine transform.
 
@@ -989,7 +1170,7 @@ class PCAContour(Contour):
     the old points[-1] is at points[0], and so forth. This doesn't change the spatial
     position of the contour, but it changes how the points are numbered.
     """
-    self.points = numpy.roll(self.points, offset, axis=0)
+    Contour.offset_points(self, offset)
     self.mean = numpy.roll(self.mean, offset, axis=0)
     self.modes = numpy.roll(self.modes, offset, axis=1)
 
@@ -1019,22 +1200,38 @@ class CentralAxisContour(Contour):
     'top_points': numpy.zeros((0, 2)), 'bottom_points': numpy.zeros((0, 2))})
 
   def from_contour(cls, contour, start, end, num_points, scale_steps=5, torsion_step=0.001,
-         spacing_step=0.001, curvature_step=0.04, overlap_step=0.1, endpoint_step=0.001, record=False):
+         spacing_step=0.001, curvature_step=0.04, overlap_step=0.1, endpoint_step=0.001, record=False,
+         initial_axis=None):
+    """Find the central axis of a contour between the given start and end
+    positions (in terms of the fractional contour point index), and return a
+    new CentralAxisContour with 'num_points' axis points.
+
+    Ordinarily, a rough axis between start and end is found by successive
+    subdivision, and then relaxed (with center_and_space_axis) at each of
+    'scale_steps' increasing numbers of axis points. If an 'initial_axis'
+    array of points running from start to end is provided (e.g. from
+    contour_tools.find_medial_axis), it is used directly and relaxed once, at
+    the final number of points; 'scale_steps' is then ignored.
+    """
     if num_points < 7:
       raise ValueError('num_points must be at least 7.')
     initial_start, initial_end = start, end
-    try:
-      num_steps = len(scale_steps)
-    except:
-      num_steps = scale_steps
-      scale_steps = numpy.linspace(7, num_points, scale_steps, endpoint=True)
     import celltool.numerics.fitpack as fitpack
-    tck, uout = contour.to_spline()
-    start_pos, end_pos = numpy.transpose(fitpack.splev([start, end], tck))
-    contour = cls(other=contour, central_axis=numpy.array([start_pos, end_pos]))
-    num_subdivisions = int(numpy.log2(scale_steps[0] - 1))
-    for i in range(num_subdivisions):
-      contour.central_axis = contour.subdivide_axis()
+    if initial_axis is not None:
+      scale_steps = [num_points]
+      contour = cls(other=contour, central_axis=numpy.asarray(initial_axis, dtype=float))
+    else:
+      try:
+        num_steps = len(scale_steps)
+      except:
+        num_steps = scale_steps
+        scale_steps = numpy.linspace(7, num_points, scale_steps, endpoint=True)
+      tck, uout = contour.to_spline()
+      start_pos, end_pos = numpy.transpose(fitpack.splev([start, end], tck))
+      contour = cls(other=contour, central_axis=numpy.array([start_pos, end_pos]))
+      num_subdivisions = int(numpy.log2(scale_steps[0] - 1))
+      for i in range(num_subdivisions):
+        contour.central_axis = contour.subdivide_axis()
     data = []
     for points in scale_steps:
       tck, uout = contour.axis_to_spline(spacing_corrected=True)
@@ -1113,144 +1310,37 @@ class CentralAxisContour(Contour):
   def center_and_space_axis(self, max_iters=500, min_rms_change=1e-6, torsion_step=0.001,
        spacing_step=0.001, curvature_step=0.04, overlap_step=0.1, endpoint_step=0.001,
        record=False):
+    """Relax the axis positions so that the central axis runs down the middle
+    of the contour, with evenly-spaced points.
+
+    Forces on each axis point (torsion, spacing, curvature, overlap, and
+    endpoint forces, scaled by the respective step parameters) are projected
+    onto the contour and used to move the axis positions along the contour,
+    until max_iters iterations have been taken or the RMS change in the
+    positions falls below min_rms_change. The iteration is carried out by the
+    _central_axis extension module, which releases the global interpreter lock
+    so that several contours can be processed in parallel threads.
+
+    Returns (iters, rms_change), or (iters, rms_change, all_positions) if
+    'record' is true, where all_positions is a list of the axis positions
+    before and after each iteration.
+    """
     tck, uout = self.to_spline()
-    n_pairs = (len(self.axis_positions)- 2) / 2
+    t, (cx, cy), k = tck
     l = len(self.points)
-    spatial_forces = numpy.zeros((len(self.axis_positions), 2), float)
-    top_force = spatial_forces[1:n_pairs+1]
-    # reverse bottom forces to match up in order with the top of each line pair
-    bottom_force = spatial_forces[n_pairs+2:][::-1]
-    torsion = numpy.empty((n_pairs, 2), float)
-    normals = numpy.empty((n_pairs, 2), float)
     length_scale = max(*self.size())
     torsion_step *= length_scale**2
     spacing_scale = self.length() / l
     overlap_step *= spacing_scale
-    iters = 0
-    ms_change = numpy.inf
-    min_ms_change = min_rms_change**2
-    transpose, concatenate, sqrt = numpy.transpose, numpy.concatenate, numpy.sqrt
-    newaxis, roll, exp, sign = numpy.newaxis, numpy.roll, numpy.exp, numpy.sign
-    searchsorted = numpy.searchsorted
-    from celltool.numerics.fitpack import splev
-    axis_positions = self.axis_positions
-    if record:
-      all_positions = [numpy.array(axis_positions, copy=True)]
-    start_i, top_i = 0, 1
-    end_i, bottom_i = n_pairs+1, n_pairs+2
-    while (iters < max_iters and ms_change > min_ms_change):
-      spatial_pos = transpose(splev(axis_positions, tck))
-      start_p = spatial_pos[start_i:top_i]
-      top_p = spatial_pos[top_i:end_i]
-      end_p = spatial_pos[end_i:bottom_i]
-      bottom_p = spatial_pos[bottom_i:][::-1]
-
-      midpoints = (top_p + bottom_p) / 2
-      axis = concatenate([start_p, midpoints, end_p])
-      axis_der = axis[2:] - axis[:-2]
-      axis_der /= sqrt((axis_der**2).sum(axis=1))[:, newaxis]
-      normals[:,0] = axis_der[:,1]
-      normals[:,1] = -axis_der[:,0]
-      TmB = top_p - bottom_p
-      torsion_denom = (normals * TmB).sum(axis=1)**3
-      torsion[:,0] = 2*(axis_der * TmB).sum(axis=1) * TmB[:,1] / torsion_denom
-      torsion[:,1] = 2*(-axis_der * TmB).sum(axis=1) * TmB[:,0] / torsion_denom
-      torsion *= -torsion_step
-      # top_force[:] = -torsion
-      # bottom_force[:] = torsion
-      top_force[1:-1] = -torsion[1:-1]
-      bottom_force[1:-1] = torsion[1:-1]
-
-      minus_previous = axis[1:] - axis[:-1]
-      minus_previous_norms = sqrt((minus_previous**2).sum(axis=1))
-      # mean_norm = minus_previous_norms.mean()
-      # mean_frac = 2*(mean_norm/minus_previous_norms - 1)
-      # spacing_vals = spacing_step * mean_frac[:, numpy.newaxis] * minus_previous
-      spacing_vals = spacing_step * -2 * minus_previous
-      spacing = (spacing_vals[1:] - spacing_vals[:-1])
-      top_force -= spacing
-      bottom_force -= spacing
-
-      endpoint_vec = minus_previous[[1, -2]]
-      TmBend = TmB[[0, -1]]
-      TmBdotEnd = (TmBend * endpoint_vec).sum(axis=1)[:, newaxis]
-      TmBendSq = (TmBend**2).sum(axis=1)[:, newaxis]
-      endpointSq = (endpoint_vec**2).sum(axis=1)[:, newaxis]
-      denom = (endpointSq * TmBendSq**2)
-      endpoint_der = endpoint_step * 2 * (endpoint_vec * TmBdotEnd * TmBendSq - TmBend * TmBdotEnd**2) / denom
-      top_force[[0, -1]] = -endpoint_der
-      bottom_force[[0, -1]] = endpoint_der
-
-      # endpoint_vec = minus_previous[[1, -2]]
-      # vec_start = axis[[1, -2]]
-      # endpoints = axis[[0, -1]]
-      # w = endpoints - vec_start
-      # c1 = (w*endpoint_vec).sum(axis=1)
-      # c2 = (endpoint_vec**2).sum(axis=1)
-      # b = c1 / c2
-      # endpoint_proj = vec_start + b[:, numpy.newaxis]*endpoint_vec
-      # proj_vec = (endpoint_proj - endpoints)
-      # # proj_vec *= numpy.sign((proj_vec * TmB[[0, -1]]).sum(axis=1))[:, numpy.newaxis]
-      # proj_vec = numpy.roll(proj_vec, 1, axis=1)
-      # proj_vec[:,0] *= -1
-      # proj_vec[1,:] *= -1
-      # proj_vec *= endpoint_step
-      # top_force[[0, -1]] += proj_vec
-      # bottom_force[[0, -1]] -= proj_vec
-
-      curvatures = curvature_step*2*(minus_previous[1:] - minus_previous[:-1])
-      curvature_vals = (curvatures[:-2] - 2*curvatures[1:-1] + curvatures[2:])
-      #top_force[0] -= -2*curvatures[0] + curvatures[1]
-      top_force[1:-1] -= curvature_vals
-      #top_force[-1] -= curvatures[-2] - 2*curvatures[-1]
-      #bottom_force[0] -= -2*curvatures[0] + curvatures[1]
-      bottom_force[1:-1] -= curvature_vals
-      #bottom_force[-1] -= curvatures[-2] - 2*curvatures[-1]
-
-      point_minus_prev = spatial_pos - roll(spatial_pos, 1, axis=0)
-      distances = sqrt((point_minus_prev**2).sum(axis=1))[:, newaxis]
-      overlap_derivatives = exp(-distances/spacing_scale) * point_minus_prev / distances
-      overlap = overlap_step*(roll(overlap_derivatives, -1, axis=0) - overlap_derivatives)
-      # top_force -= overlap[top_i:end_i]
-      # bottom_force -= overlap[bottom_i:][::-1]
-      top_force[1:-1] -= overlap[top_i+1:end_i-1]
-      bottom_force[1:-1] -= overlap[bottom_i+1:-1][::-1]
-
-      pos_d = transpose(splev(axis_positions, tck, 1))
-      pos_d /= (pos_d**2).sum(axis=1)[:, newaxis]
-      contour_forces = (spatial_forces * pos_d).sum(axis=1)
-      old_positions = axis_positions.copy()
-      axis_positions += contour_forces
-      axis_positions %= l
-      # find the point midway between the first pair of points along the axis
-      (c1, c2), (d1, d2) = self.find_contour_midpoints(axis_positions[1], axis_positions[-1])
-      if abs(d1) < abs(d2):
-        start = axis_positions[start_i] = c1
-      else:
-        start = axis_positions[start_i] = c2
-      (c1, c2), (d1, d2) = self.find_contour_midpoints(axis_positions[n_pairs], axis_positions[n_pairs+2])
-      if abs(d1) < abs(d2):
-        end = axis_positions[end_i] = c1
-      else:
-        end = axis_positions[end_i] = c2
-      axis_positions.sort()
-      # if start < end:
-      #   top = axis_positions[(axis_positions > start) & (axis_positions < end)]
-      #   bottom = concatenate([axis_positions[axis_positions > end], axis_positions[axis_positions < start]])
-      # else:
-      #   top = axis_positions[(axis_positions > end) & (axis_positions < start)][::-1]
-      #   bottom = concatenate([axis_positions[axis_positions > start], axis_positions[axis_positions < end]])[::-1]
-      # axis_positions = concatenate([[start], top, [end], bottom])
-      axis_positions = roll(axis_positions, -searchsorted(axis_positions, start))
-      ms_change = (((axis_positions - old_positions))**2).mean()
-      iters += 1
-      if record:
-        all_positions.append(numpy.array(axis_positions, copy=True))
+    from celltool.numerics import _central_axis
+    axis_positions, iters, ms_change, all_positions = _central_axis.center_and_space_axis(
+      self.axis_positions, t, cx, cy, k, l, max_iters, min_rms_change**2, torsion_step,
+      spacing_step, curvature_step, overlap_step, endpoint_step, spacing_scale, record)
     self.axis_positions = axis_positions
     self.recalculate_central_axis(tck)
     if record:
-      return iters, sqrt(ms_change), all_positions
-    return iters, sqrt(ms_change)
+      return iters, numpy.sqrt(ms_change), list(all_positions)
+    return iters, numpy.sqrt(ms_change)
 
   def transform(self, transform):
     Contour.transform(self, transform)
@@ -1734,35 +1824,163 @@ class CentralAxisContour(Contour):
   # as_points_from_axis = _copymethod(make_points_from_axis)
   # as_straightened = _copymethod(straighten)
 
+def _is_similarity(linear):
+  """Return (True, scale) if the 2x2 matrix is a rotation/reflection times a
+  uniform scale factor, and (False, None) otherwise."""
+  gram = numpy.dot(linear, linear.transpose())
+  scale_squared = gram[0,0]
+  if scale_squared > 0 and numpy.allclose(gram, scale_squared * numpy.eye(2)):
+    return True, numpy.sqrt(scale_squared)
+  return False, None
+
+def _transform_derived(derived, transform):
+  """Update a Contour's cache of derived geometry to reflect the application of
+  the given 3x3 homogenous transform to the points. Values which cannot be
+  cheaply and exactly transformed are dropped."""
+  if not derived or not numpy.allclose(transform[:,2], [0, 0, 1]):
+    return {}
+  linear = transform[:2,:2]
+  translation = transform[2,:2]
+  new = {}
+  if 'spline' in derived:
+    # B-spline bases sum to unity, so the (linear) interpolating-spline fit
+    # commutes with affine transforms of the data: just transform the
+    # coefficients.
+    (t, c, k), uout = derived['spline']
+    c = numpy.dot(numpy.transpose(c), linear) + translation
+    new['spline'] = [t, list(numpy.transpose(c)), k], uout
+  for key, value in derived.items():
+    if isinstance(key, tuple) and key[0] == 'derivative':
+      new[key] = numpy.dot(value, linear)
+  if 'signed_area' in derived:
+    new['signed_area'] = derived['signed_area'] * numpy.linalg.det(linear)
+  similarity, scale = _is_similarity(linear)
+  if similarity and 'interpoint_distances' in derived:
+    new['interpoint_distances'] = derived['interpoint_distances'] * scale
+  return new
+
+def _offset_derived(derived, offset):
+  """Update a Contour's cache of derived geometry to reflect an offset of the
+  point ordering. Per-point values are just rolled; the spline itself is
+  parameterized by point number and so must be re-fit."""
+  new = {}
+  for key, value in derived.items():
+    if key in ('signed_area', 'bounding_box'):
+      new[key] = value
+    elif key in ('interpoint_distances', 'curvatures', 'inward_normals') or (
+        isinstance(key, tuple) and key[0] == 'derivative'):
+      new[key] = numpy.roll(value, offset, axis=0)
+  return new
+
+def _reverse_derived(derived):
+  """Update a Contour's cache of derived geometry to reflect a reversal of the
+  point ordering."""
+  new = {}
+  for key, value in derived.items():
+    if key == 'bounding_box':
+      new[key] = value
+    elif key == 'signed_area':
+      new[key] = -value
+    elif key == 'interpoint_distances':
+      # distance from each point to the previous: after reversal, the
+      # 'previous' point is the old 'next' point.
+      new[key] = numpy.roll(numpy.flipud(value), 1, axis=0)
+    elif key == 'inward_normals':
+      new[key] = numpy.flipud(value)
+    elif key == 'curvatures':
+      new[key] = -numpy.flipud(value)
+    elif isinstance(key, tuple) and key[0] == 'derivative':
+      # odd derivatives change sign when the parameterization is reversed.
+      new[key] = ((-1)**key[1]) * numpy.flipud(value)
+  return new
+
 def calculate_mean_contour(contours):
   """Calculate the average of a set of contours, while retaining units and
   scaling information, if possible. If all contours have associated landmarks,
   then the average will be such a contour as well."""
-  all_points = [c.points for c in contours]
-  if not utility_tools.all_same_shape(all_points):
-    raise ContourError('Cannot calculate mean of contours with different numbers of points.')
-  mean_points = numpy.mean(all_points, axis=0)
-  units = [c.units for c in contours]
-  if not numpy.alltrue([u == units[0] for u in units]):
-    raise ContourError('All contours must have the same units in order calculate their mean.')
-  units = contours[0].units
-  scales = [utility_tools.decompose_homogenous_transform(c.to_world_transform)[1] for c in contours]
-  if numpy.alltrue([numpy.allclose(scales[0], s) for s in scales[1:]]):
-    transform = utility_tools.make_homogenous_transform(transform=scales[0])
-  else:
-    transform = numpy.eye(3)
-  if numpy.alltrue([isinstance(c, ContourAndLandmarks) for c in contours]):
-    # if they're all landmark'd contours
-    all_landmarks = [c.landmarks for c in contours]
-    if not utility_tools.all_same_shape(all_landmarks):
-      raise ContourError('Cannot calculate mean of contours with different numbers of landmarks.')
-    mean_landmarks = numpy.mean(all_landmarks, axis=0)
-    mean_weights = numpy.mean([c.weights for c in contours], axis=0)
-    return ContourAndLandmarks(points=mean_points, units=units, landmarks=mean_landmarks,
-      weights=mean_weights, to_world_transform=transform)
-  else:
-    return Contour(points=mean_points, units=units, to_world_transform=transform)
-
+  return MeanContourAccumulator(contours).mean()
+
+class MeanContourAccumulator(object):
+  """Maintain the average of a set of contours as individual contours change.
+
+  The sums of the contour points (and landmarks and weights, if all of the
+  contours have them) are kept, so that when a contour changes, the mean can
+  be updated in time proportional to the number of points, rather than to the
+  number of contours. To update the mean, remove a contour before changing it
+  and add it back afterward:
+    accumulator.remove(contour)
+    contour.transform(...)
+    accumulator.add(contour)
+    mean = accumulator.mean()
+  Removing a contour that has changed since it was added will give incorrect
+  results.
+
+  As in calculate_mean_contour, units and scaling information are retained in
+  the mean if they are the same for all contours.
+  """
+  def __init__(self, contours=()):
+    self.count = 0
+    self.landmark_count = 0
+    self.points_sum = None
+    self.landmarks_sum = None
+    self.weights_sum = None
+    self.units = None
+    self.scale = None
+    self.scale_mismatches = 0
+    for contour in contours:
+      self.add(contour)
+
+  def add(self, contour):
+    """Add a contour to the set being averaged."""
+    self._update(contour, 1)
+
+  def remove(self, contour):
+    """Remove a contour (which must be unchanged since it was added) from the
+    set being averaged."""
+    if self.count == 0:
+      raise ContourError('Cannot remove a contour from an empty mean.')
+    self._update(contour, -1)
+
+  def _update(self, contour, sign):
+    if self.count == 0:
+      self.points_sum = numpy.zeros(contour.points.shape, dtype=float)
+      self.units = contour.units
+    elif contour.points.shape != self.points_sum.shape:
+      raise ContourError('Cannot calculate mean of contours with different numbers of points.')
+    elif contour.units != self.units:
+      raise ContourError('All contours must have the same units in order calculate their mean.')
+    if isinstance(contour, ContourAndLandmarks):
+      if self.landmark_count == 0:
+        self.landmarks_sum = numpy.zeros(contour.landmarks.shape, dtype=float)
+        self.weights_sum = numpy.zeros(numpy.asarray(contour.weights, dtype=float).shape, dtype=float)
+      elif contour.landmarks.shape != self.landmarks_sum.shape:
+        raise ContourError('Cannot calculate mean of contours with different numbers of landmarks.')
+      self.landmarks_sum += sign * contour.landmarks
+      self.weights_sum = self.weights_sum + sign * numpy.asarray(contour.weights, dtype=float)
+      self.landmark_count += sign
+    scale = utility_tools.decompose_homogenous_transform(contour.to_world_transform)[1]
+    if self.count == 0:
+      self.scale = scale
+    elif not numpy.allclose(self.scale, scale):
+      self.scale_mismatches += sign
+    self.points_sum += sign * contour.points
+    self.count += sign
+
+  def mean(self):
+    """Return the mean of the contours, as calculate_mean_contour would."""
+    if self.count == 0:
+      raise ContourError('Cannot calculate the mean of zero contours.')
+    mean_points = self.points_sum / self.count
+    if self.scale_mismatches == 0:
+      transform = utility_tools.make_homogenous_transform(transform=self.scale)
+    else:
+      transform = numpy.eye(3)
+    if self.landmark_count == self.count:
+      return ContourAndLandmarks(points=mean_points, units=self.units,
+        landmarks=self.landmarks_sum / self.count, weights=self.weights_sum / self.count,
+        to_world_transform=transform)
+    else:
+      return Contour(points=mean_points, units=self.units, to_world_transform=transform)
 
 def from_file(filename, force_class=None):
   """Load a PointSet or subclass (e.g. Contour) from a file.
@@ -119,14 +119,15 @@ def align_contour_to(contour, reference, global_align = True, align_steps = 8, a
 
 def align_contours(contours, align_steps = 8, allow_reflection = False, 
     allow_scaling = False, weights = None, max_iters = 10, min_rms_change = None,
-    quick = False, iteration_callback = None):
+    quick = False, iteration_callback = None, online = False):
   """Mutually align a set of contours to their mean in an expectation-maximization
   fashion. The input contous will be transformed IN PLACE to reflect this alignment.
   
   For each iteration, the mean contour is calculated, and then each contour is
   globally aligned to that mean with the celltool.contour_class.Contour.global_best_alignment
   method. Iteration continues until no contours are changed (beyond a given
-  threshold), or the maximum number of iterations elapses.
+  threshold), or the maximum number of iterations elapses. The mean is
+  maintained incrementally with a contour_class.MeanContourAccumulator.
   
   Parameters:
     - align_steps: The number of different contour orientations to consider
@@ -156,6 +157,10 @@ def align_contours(contours, align_steps = 8, allow_reflection = False,
        where iters is the current iteration, i is the number of the contour
        that was just aligned, and changed is the number of contours changed
        so far during that iteration.
+    - online: if True, the mean is updated after each contour is aligned,
+       rather than once per iteration. This typically requires fewer
+       iterations to converge, but the result depends on the order of the
+       contours.
   
   See celltool.contour_class.Contour.global_best_alignment, which is used
   internally by this function, for more details.
@@ -169,7 +174,8 @@ def align_contours(contours, align_steps = 8, allow_reflection = False,
   for c in contours:
     c.axis_align()
     c.global_reorder_points(reference = contours[0])
-  mean = contour_class.calculate_mean_contour(contours)
+  accumulator = contour_class.MeanContourAccumulator(contours)
+  mean = accumulator.mean()
   if min_rms_change is None:
     # set the min RMSD to 0.01 of the largest dimension of the mean shape.
     min_rms_change = 0.01 * mean.size().max()
@@ -180,15 +186,19 @@ def align_contours(contours, align_steps = 8, allow_reflection = False,
     changed = 0
     for i, contour in enumerate(contours):
       original_points = contour.points[:]
+      accumulator.remove(contour)
       contour.global_best_alignment(mean, align_steps, weights, allow_reflection, 
         allow_scaling, allow_translation, allow_reversed_orientation, quick)        
+      accumulator.add(contour)
+      if online:
+        mean = accumulator.mean()
       ms_change = ((contour.points - original_points)**2).mean()
       if ms_change > min_ms_change:
         changed += 1
       if iteration_callback is not None:
         iteration_callback(iters, i, changed)
     iters += 1
-    mean = contour_class.calculate_mean_contour(contours)
+    mean = accumulator.mean()
   return iters
 
 def get_binary_mask(contour, size, domain = None):
@@ -243,6 +253,111 @@ def get_signed_distance_map(contour, size, domain = None):
   else:
     return signed_distance
 
+def find_medial_axis(contour, samples = 100, prune = 0.25, smooth_steps = 3):
+  """Estimate the central axis of a contour from its medial axis.
+
+  The closest-point transform of the contour is calculated on a grid with
+  'samples' points along the longer side of the contour's bounding box. Grid
+  points inside the contour whose closest contour points are far from those
+  of a neighboring grid point lie on the medial axis (the skeleton). Only
+  neighbors whose closest points are separated by more than 'prune' times the
+  maximum width of the contour count, which removes the short spurious
+  branches caused by small bumps on the contour. The longest path through the
+  skeleton is then traced, smoothed with 'smooth_steps' rounds of neighbor
+  averaging, and extended along its end directions out to the contour.
+
+  Returns (axis, start, end), where 'axis' is an array of points along the
+  medial axis (including the endpoints on the contour), and 'start' and 'end'
+  are the contour positions (in terms of the fractional point index) of the
+  axis endpoints. This is a good initial axis for
+  CentralAxisContour.from_contour.
+  """
+  import celltool.numerics.closest_point_transform as closest_point_transform
+  mins, maxes = contour.bounding_box()
+  spacing = (maxes - mins).max() / float(samples - 1)
+  # pad the domain by a couple of grid points on each side
+  mins = mins - 2 * spacing
+  maxes = maxes + 2 * spacing
+  extents = numpy.ceil((maxes - mins) / spacing).astype(int) + 1
+  maxes = mins + (extents - 1) * spacing
+  domain = (mins[0], mins[1], maxes[0], maxes[1])
+  distances, closest_points, gradient = closest_point_transform.cpt_2d(contour.points,
+    domain = domain, samples = (int(extents[0]), int(extents[1])), find_closest_points = True)
+  if contour.signed_area() > 0:
+    distances = -distances
+  inside = distances < 0
+  min_separation = prune * 2 * -distances.min()
+  skeleton = numpy.zeros(distances.shape, dtype = bool)
+  for axis in (0, 1):
+    lower = [slice(None), slice(None)]
+    upper = [slice(None), slice(None)]
+    lower[axis] = slice(None, -1)
+    upper[axis] = slice(1, None)
+    lower, upper = tuple(lower), tuple(upper)
+    separation = ((closest_points[(slice(None),) + upper] - closest_points[(slice(None),) + lower])**2).sum(axis = 0)
+    ridge = inside[lower] & inside[upper] & (separation > min_separation**2)
+    # of each neighboring pair, mark the point farther from the contour
+    lower_deeper = distances[lower] <= distances[upper]
+    skeleton[lower] |= ridge & lower_deeper
+    skeleton[upper] |= ridge & ~lower_deeper
+  path = _longest_skeleton_path(skeleton)
+  if len(path) < 2:
+    raise ValueError('Could not find the medial axis of the contour: try increasing the number of samples or decreasing the prune value.')
+  axis = mins + numpy.array(path, dtype = float) * spacing
+  for i in range(smooth_steps):
+    axis[1:-1] = (axis[:-2] + 2 * axis[1:-1] + axis[2:]) / 4
+  # extend each end of the axis to the contour, along the direction of the
+  # last few axis points
+  back = min(3, len(axis) - 1)
+  ray_starts = axis[[0, -1]]
+  ray_ends = 2 * ray_starts - axis[[back, -1 - back]]
+  radii, positions = contour.find_shape_intersections(ray_starts, ray_ends)
+  forward = radii >= 0
+  radii = numpy.where(forward[:,0], radii[:,0], radii[:,1])
+  positions = numpy.where(forward[:,0], positions[:,0], positions[:,1])
+  end_points = ray_starts + radii[:, numpy.newaxis] * (ray_ends - ray_starts)
+  axis = numpy.concatenate([end_points[:1], axis, end_points[1:]])
+  start, end = positions % len(contour.points)
+  return axis, start, end
+
+def _longest_skeleton_path(skeleton):
+  """Return the list of (x, y) indices along the longest path (in terms of
+  the number of steps between 8-connected neighbors) through any connected
+  component of a skeleton image."""
+  neighbors = [(i, j) for i in (-1, 0, 1) for j in (-1, 0, 1) if i or j]
+  nodes = {}
+  for node in zip(*skeleton.nonzero()):
+    nodes[tuple(node)] = None
+  def farthest_from(source):
+    # breadth-first search; returns the farthest node and the search tree
+    parents = {source:None}
+    queue = [source]
+    index = 0
+    while index < len(queue):
+      x, y = queue[index]
+      index += 1
+      for i, j in neighbors:
+        neighbor = (x + i, y + j)
+        if neighbor in nodes and neighbor not in parents:
+          parents[neighbor] = (x, y)
+          queue.append(neighbor)
+    return queue[-1], parents
+  best_path = []
+  while nodes:
+    # the farthest node from any starting point is one end of the longest path
+    # (exactly so for trees); the farthest node from that is the other end.
+    first, parents = farthest_from(nodes.keys()[0])
+    last, parents = farthest_from(first)
+    for node in parents:
+      del nodes[node]
+    path = []
+    while last is not None:
+      path.append(last)
+      last = parents[last]
+    if len(path) > len(best_path):
+      best_path = path
+  return best_path
+
 
 def transform_image_to_contour(contour, image_array, size = None, mask = False):
   """Transform an image to be in the reference frame of a given contour.
@@ -499,7 +614,8 @@ def add_image_landmarks(contour, image_array, landmark_ranges, image_type = 'ori
   return landmark_contour
 
 def warp_images(from_contour, to_contour, image_arrays, output_region = None, 
-    from_type = 'original', to_type = 'original', interpolation_order = 1, approximate_grid = 1):
+    from_type = 'original', to_type = 'original', interpolation_order = 1, approximate_grid = 1,
+    tolerance = None, warp_type = 'thin-plate'):
   """Define a thin-plate-spline warping transform that warps from the points of
   from_contour to the points of to_contour (and their landmarks, if they have any),
   and then warp the given images by that transform. In general, 'from_contour'
@@ -532,6 +648,13 @@ def warp_images(from_contour, to_contour, image_arrays, output_region = None,
         times smaller than the output image region, and then the transform is
         bilinearly interpolated to the larger region. This is fairly accurate
         for values up to 10 or so.  
+    - tolerance: if not None, the warping transform is calculated with a fast
+        approximation to about this relative accuracy, which is much faster
+        when the contours have many points (see image_warp.warp_images).
+    - warp_type: if 'thin-plate', warp by a thin-plate spline; if
+        'piecewise-affine', triangulate the points and warp each triangle by an
+        affine transform, which is much faster for many points, but leaves
+        the region outside of the to_contour's convex hull blank.
   """
   import celltool.numerics.image_warp as image_warp
   _compatibility_check([from_contour, to_contour])
@@ -566,5 +689,5 @@ def warp_images(from_contour, to_contour, image_arrays, output_region = None,
     from_contour._pack_landmarks_into_points()
     to_contour._pack_landmarks_into_points()
   return image_warp.warp_images(from_contour.points, to_contour.points, image_arrays,
-    output_region, interpolation_order, approximate_grid)
+    output_region, interpolation_order, approximate_grid, tolerance=tolerance, warp_type=warp_type)
   
\ No newline at end of file
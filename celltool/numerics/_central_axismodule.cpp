@@ -0,0 +1,360 @@
+// Copyright 2007 Zachary Pincus
+// This file is part of CellTool.
+//
+// CellTool is free software; you can redistribute it and/or modify
+// it under the terms of version 2 of the GNU General Public License as
+// published by the Free Software Foundation.
+
+#include <Python.h>
+#include "numpy/arrayobject.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+static char _central_axis_doc[] =
+"This module defines a C++ implementation of the force-based central axis\n\
+relaxation used by celltool.contour.contour_class.CentralAxisContour";
+
+
+// A parametric 2D B-spline, as produced by fitpack's splprep. Evaluation
+// follows fitpack's splev/splder: positions outside of the knot range are
+// extrapolated from the end intervals.
+class Spline {
+public:
+  Spline(const double* knots, int num_knots, const double* x_coefs,
+    const double* y_coefs, int degree)
+    : t(knots), n(num_knots), cx(x_coefs), cy(y_coefs), k(degree) {}
+
+  // Evaluate the spline position and first derivative at parameter u.
+  inline void evaluate(double u, double& x, double& y, double& dx, double& dy) const {
+    double h[6], hh[6], h_lower[6];
+    // find l such that t[l] <= u < t[l+1], with k <= l <= n-k-2
+    int l = int(std::upper_bound(t + k + 1, t + n - k - 1, u) - t) - 1;
+    // Cox-de Boor recursion, saving the degree k-1 basis values for the
+    // derivative calculation.
+    h[0] = 1;
+    for (int j = 1; j <= k; j++) {
+      if (j == k) {
+        for (int i = 0; i < j; i++) h_lower[i] = h[i];
+      }
+      for (int i = 0; i < j; i++) hh[i] = h[i];
+      h[0] = 0;
+      for (int i = 1; i <= j; i++) {
+        double li = t[l + i];
+        double lj = t[l + i - j];
+        double f = hh[i - 1] / (li - lj);
+        h[i - 1] += f * (li - u);
+        h[i] = f * (u - lj);
+      }
+    }
+    x = y = 0;
+    for (int m = 0; m <= k; m++) {
+      x += cx[l - k + m] * h[m];
+      y += cy[l - k + m] * h[m];
+    }
+    dx = dy = 0;
+    for (int m = 0; m < k; m++) {
+      int j = l - k + 1 + m;
+      double scale = k / (t[l + 1 + m] - t[j]);
+      dx += scale * (cx[j] - cx[j - 1]) * h_lower[m];
+      dy += scale * (cy[j] - cy[j - 1]) * h_lower[m];
+    }
+  }
+
+private:
+  const double* t;
+  int n;
+  const double* cx;
+  const double* cy;
+  int k;
+};
+
+struct RelaxationParameters {
+  int max_iters;
+  double min_ms_change;
+  double torsion_step;
+  double spacing_step;
+  double curvature_step;
+  double overlap_step;
+  double endpoint_step;
+  double spacing_scale;
+};
+
+// python-style modulus: the result has the same sign as the divisor.
+static inline double py_mod(double a, double b) {
+  double r = std::fmod(a, b);
+  if (r != 0 && ((r < 0) != (b < 0))) r += b;
+  return r;
+}
+
+// Relaxation of the central axis of a contour, as in the python method
+// CentralAxisContour.center_and_space_axis. The axis is represented by
+// 'num_positions' positions along the contour: the starting point, the points
+// along the top of the contour, the ending point, and the points along the
+// bottom (in reverse order). The top and bottom points are paired up, and the
+// axis runs through the midpoints of each pair. Each iteration computes the
+// torsion, spacing, endpoint, curvature and overlap forces on each position
+// and moves the positions along the contour accordingly.
+// All buffers are allocated once, up front.
+class AxisRelaxation {
+public:
+  AxisRelaxation(const Spline& contour_spline, int contour_points, int num_positions)
+    : spline(contour_spline), l(contour_points), N(num_positions), np((num_positions - 2) / 2),
+      S(2*N), D(2*N), F(2*N), old(N), A(2*(np+2)), MP(2*(np+1)),
+      TmB(2*np), axis_der(2*np), curv(2*np), od(2*N) {}
+
+  int run(double* a, const RelaxationParameters& p, double& ms_change, std::vector<double>* history) {
+    int iters = 0;
+    ms_change = HUGE_VAL;
+    std::fill(F.begin(), F.end(), 0.0);
+    if (history) history->insert(history->end(), a, a + N);
+    while (iters < p.max_iters && ms_change > p.min_ms_change) {
+      step(a, p);
+      ms_change = 0;
+      for (int i = 0; i < N; i++) {
+        double d = a[i] - old[i];
+        ms_change += d * d;
+      }
+      ms_change /= N;
+      iters++;
+      if (history) history->insert(history->end(), a, a + N);
+    }
+    return iters;
+  }
+
+private:
+  // accessors for the spatial positions / forces of the top and bottom points
+  // of each pair (bottom points are stored in reverse order).
+  inline int top(int j) const { return 1 + j; }
+  inline int bottom(int j) const { return N - 1 - j; }
+
+  void step(double* a, const RelaxationParameters& p) {
+    int i, j;
+    for (i = 0; i < N; i++) {
+      spline.evaluate(a[i], S[2*i], S[2*i+1], D[2*i], D[2*i+1]);
+    }
+    // the axis: start, the pair midpoints, and the end.
+    A[0] = S[0]; A[1] = S[1];
+    for (j = 0; j < np; j++) {
+      int t = top(j), b = bottom(j);
+      A[2*(j+1)] = (S[2*t] + S[2*b]) / 2;
+      A[2*(j+1)+1] = (S[2*t+1] + S[2*b+1]) / 2;
+      TmB[2*j] = S[2*t] - S[2*b];
+      TmB[2*j+1] = S[2*t+1] - S[2*b+1];
+    }
+    A[2*(np+1)] = S[2*(np+1)]; A[2*(np+1)+1] = S[2*(np+1)+1];
+    for (i = 0; i <= np; i++) {
+      MP[2*i] = A[2*(i+1)] - A[2*i];
+      MP[2*i+1] = A[2*(i+1)+1] - A[2*i+1];
+    }
+    for (j = 0; j < np; j++) {
+      double x = A[2*(j+2)] - A[2*j];
+      double y = A[2*(j+2)+1] - A[2*j+1];
+      double norm = std::sqrt(x*x + y*y);
+      axis_der[2*j] = x / norm;
+      axis_der[2*j+1] = y / norm;
+    }
+    for (j = 0; j < np; j++) {
+      curv[2*j] = p.curvature_step * 2 * (MP[2*(j+1)] - MP[2*j]);
+      curv[2*j+1] = p.curvature_step * 2 * (MP[2*(j+1)+1] - MP[2*j+1]);
+    }
+    // overlap derivatives between each contour position and the previous one
+    for (i = 0; i < N; i++) {
+      int prev = (i + N - 1) % N;
+      double x = S[2*i] - S[2*prev];
+      double y = S[2*i+1] - S[2*prev+1];
+      double d = std::sqrt(x*x + y*y);
+      double e = std::exp(-d / p.spacing_scale) / d;
+      od[2*i] = e * x;
+      od[2*i+1] = e * y;
+    }
+
+    // forces on the interior pairs: torsion, spacing, curvature, and overlap.
+    for (j = 1; j < np - 1; j++) {
+      double ax = axis_der[2*j], ay = axis_der[2*j+1];
+      double tx = TmB[2*j], ty = TmB[2*j+1];
+      double nx = ay, ny = -ax;
+      double denom = nx*tx + ny*ty;
+      denom = denom * denom * denom;
+      double dot = ax*tx + ay*ty;
+      double torsion_x = -p.torsion_step * 2 * dot * ty / denom;
+      double torsion_y = -p.torsion_step * 2 * -dot * tx / denom;
+      double spacing_x = p.spacing_step * -2 * (MP[2*(j+1)] - MP[2*j]);
+      double spacing_y = p.spacing_step * -2 * (MP[2*(j+1)+1] - MP[2*j+1]);
+      double curvature_x = curv[2*(j-1)] - 2*curv[2*j] + curv[2*(j+1)];
+      double curvature_y = curv[2*(j-1)+1] - 2*curv[2*j+1] + curv[2*(j+1)+1];
+      int t = top(j), b = bottom(j);
+      F[2*t] = -torsion_x - spacing_x - curvature_x - overlap(t, 0, p);
+      F[2*t+1] = -torsion_y - spacing_y - curvature_y - overlap(t, 1, p);
+      F[2*b] = torsion_x - spacing_x - curvature_x - overlap(b, 0, p);
+      F[2*b+1] = torsion_y - spacing_y - curvature_y - overlap(b, 1, p);
+    }
+    // forces on the pairs at either end of the axis.
+    for (int e = 0; e < 2; e++) {
+      j = e ? np - 1 : 0;
+      int v = e ? np - 1 : 1;
+      double ex = MP[2*v], ey = MP[2*v+1];
+      double tx = TmB[2*j], ty = TmB[2*j+1];
+      double tdot = tx*ex + ty*ey;
+      double tsq = tx*tx + ty*ty;
+      double esq = ex*ex + ey*ey;
+      double denom = esq * tsq * tsq;
+      double der_x = p.endpoint_step * 2 * (ex*tdot*tsq - tx*tdot*tdot) / denom;
+      double der_y = p.endpoint_step * 2 * (ey*tdot*tsq - ty*tdot*tdot) / denom;
+      F[2*top(j)] = -der_x;
+      F[2*top(j)+1] = -der_y;
+      F[2*bottom(j)] = der_x;
+      F[2*bottom(j)+1] = der_y;
+    }
+
+    // project the spatial forces onto the contour tangents to move the
+    // positions along the contour.
+    for (i = 0; i < N; i++) {
+      double dx = D[2*i], dy = D[2*i+1];
+      double dsq = dx*dx + dy*dy;
+      old[i] = a[i];
+      a[i] = py_mod(a[i] + (F[2*i]*dx + F[2*i+1]*dy) / dsq, l);
+    }
+    // put the start and end points midway between the first and last pairs.
+    double start = a[0] = midpoint(a[1], a[N-1]);
+    a[np+1] = midpoint(a[np], a[np+2]);
+    std::sort(a, a + N);
+    int offset = int(std::lower_bound(a, a + N, start) - a);
+    std::rotate(a, a + offset, a + N);
+  }
+
+  inline double overlap(int i, int dim, const RelaxationParameters& p) const {
+    return p.overlap_step * (od[2*((i+1)%N)+dim] - od[2*i+dim]);
+  }
+
+  // see Contour.find_contour_midpoints: choose the midpoint along the shorter
+  // of the two arcs between the points.
+  inline double midpoint(double p1, double p2) const {
+    if (p2 < p1) std::swap(p1, p2);
+    double ca = (p2 + p1) / 2;
+    double da = ca - p1;
+    if (std::fabs(da) < std::fabs(da - l/2.)) return ca;
+    return py_mod(ca - l/2., l);
+  }
+
+  const Spline& spline;
+  double l;
+  int N, np;
+  std::vector<double> S, D, F, old, A, MP, TmB, axis_der, curv, od;
+};
+
+
+static char center_and_space_axis_doc[] =
+"center_and_space_axis(axis_positions, knots, x_coefs, y_coefs, degree,\n\
+    contour_points, max_iters, min_ms_change, torsion_step, spacing_step,\n\
+    curvature_step, overlap_step, endpoint_step, spacing_scale, record) -> \n\
+   (axis_positions, iters, ms_change, history [or None])\n\
+\n\
+axis_positions: 1D array of contour positions defining the axis. A relaxed\n\
+   copy is returned.\n\
+knots, x_coefs, y_coefs, degree: the contour's periodic parametric spline.\n\
+contour_points: the number of points in the contour.\n\
+max_iters, min_ms_change: iteration stops after max_iters iterations or when\n\
+   the mean squared change in the positions falls below min_ms_change.\n\
+torsion_step, etc.: force scaling factors; see\n\
+   CentralAxisContour.center_and_space_axis.\n\
+record: if True, return a (iters+1, n) array of the positions after each\n\
+   iteration.\n\
+\n\
+The global interpreter lock is released during the calculation.";
+
+static PyObject*
+center_and_space_axis(PyObject *self, PyObject *args)
+{
+  PyObject* positions_array = NULL;
+  PyObject* knots_array = NULL;
+  PyObject* x_array = NULL;
+  PyObject* y_array = NULL;
+  PyObject* history_array = NULL;
+  int degree, contour_points, record;
+  RelaxationParameters params;
+  int iters;
+  double ms_change;
+  npy_intp num_positions, num_knots;
+  npy_intp history_dims[2];
+  std::vector<double> history;
+  PyObject* return_tuple;
+
+  if (!PyArg_ParseTuple(args, "OOOOiiidddddddi:center_and_space_axis",
+      &positions_array, &knots_array, &x_array, &y_array, &degree, &contour_points,
+      &params.max_iters, &params.min_ms_change, &params.torsion_step, &params.spacing_step,
+      &params.curvature_step, &params.overlap_step, &params.endpoint_step,
+      &params.spacing_scale, &record)) return NULL;
+
+  // the returned positions array is always a new copy
+  positions_array = PyArray_FromAny(positions_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY | NPY_ENSURECOPY, NULL);
+  knots_array = PyArray_FromAny(knots_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  x_array = PyArray_FromAny(x_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  y_array = PyArray_FromAny(y_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  if (!positions_array || !knots_array || !x_array || !y_array) goto fail;
+
+  num_positions = PyArray_DIM(positions_array, 0);
+  num_knots = PyArray_DIM(knots_array, 0);
+  if (num_positions < 8 || num_positions % 2 != 0) {
+    PyErr_SetString(PyExc_ValueError, "axis_positions must have an even number of elements, at least 8.");
+    goto fail;
+  }
+  if (degree < 1 || degree > 5 || num_knots < 2*degree + 2 ||
+      PyArray_DIM(x_array, 0) < num_knots - degree - 1 ||
+      PyArray_DIM(y_array, 0) < num_knots - degree - 1) {
+    PyErr_SetString(PyExc_ValueError, "Invalid spline knots or coefficients.");
+    goto fail;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  {
+    Spline spline((double*) PyArray_DATA(knots_array), num_knots,
+      (double*) PyArray_DATA(x_array), (double*) PyArray_DATA(y_array), degree);
+    AxisRelaxation relaxation(spline, contour_points, num_positions);
+    iters = relaxation.run((double*) PyArray_DATA(positions_array), params, ms_change,
+      record ? &history : NULL);
+  }
+  Py_END_ALLOW_THREADS
+
+  if (record) {
+    history_dims[0] = iters + 1;
+    history_dims[1] = num_positions;
+    history_array = PyArray_SimpleNew(2, history_dims, NPY_DOUBLE);
+    if (!history_array) goto fail;
+    std::copy(history.begin(), history.end(), (double*) PyArray_DATA(history_array));
+  }
+
+  return_tuple = Py_BuildValue("(Oid" "O)", positions_array, iters, ms_change,
+    history_array ? history_array : Py_None);
+  Py_XDECREF(history_array);
+  Py_DECREF(y_array);
+  Py_DECREF(x_array);
+  Py_DECREF(knots_array);
+  Py_DECREF(positions_array);
+  return return_tuple;
+
+  fail:
+  Py_XDECREF(history_array);
+  Py_XDECREF(y_array);
+  Py_XDECREF(x_array);
+  Py_XDECREF(knots_array);
+  Py_XDECREF(positions_array);
+  return NULL;
+}
+
+
+static PyMethodDef _central_axis_methods[] = {
+  {"center_and_space_axis", center_and_space_axis, METH_VARARGS, center_and_space_axis_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC
+init_central_axis(void)
+{
+  Py_InitModule3("_central_axis", _central_axis_methods, _central_axis_doc);
+  import_array();
+}
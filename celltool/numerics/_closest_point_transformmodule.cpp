@@ -111,7 +111,7 @@ cpt_2d(PyObject *self, PyObject *args)
   // Now compute the CPT
   state.setParameters(domain, max_distance);
   state.setBRepWithNoClipping(vertex_dims[0], vertex_data, arc_dims[0], arc_data);
-  state.setLattice(extents, domain);
+  state.setLattice(int_extents, domain);
   
   // The CPT code allows for grids to inhabit sub-regions of the lattice
   // defined above. We want to use the entire lattice, so we pass the first
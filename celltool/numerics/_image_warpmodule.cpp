@@ -0,0 +1,1264 @@
+// Copyright 2007 Zachary Pincus
+// This file is part of CellTool.
+//
+// CellTool is free software; you can redistribute it and/or modify
+// it under the terms of version 2 of the GNU General Public License as
+// published by the Free Software Foundation.
+
+#include <Python.h>
+#include "numpy/arrayobject.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static char _image_warp_doc[] =
+"This module provides fast evaluation of thin-plate-spline and piecewise-affine\n\
+warps.";
+
+// The thin-plate-spline radial basis function in terms of the squared
+// distance: U = r^2 log(r) = r2 log(r2) / 2, here without the factor of 1/2.
+// This is written without calls, branches or floating-point comparisons
+// (which may trap, and thus block vectorization) so that loops over it
+// vectorize; libm's log() does not, in general. r2 is split into 2^e * m
+// with m in [sqrt(1/2), sqrt(2)), and log(m) = 2 atanh(s) with
+// s = (m-1)/(m+1) is summed as a series in s; since |s| < 0.172, the terms
+// through s^21 give full double precision. The exponent is converted to a
+// double by placing it in the mantissa of 2^52. The range tests are done on
+// the bits of the (non-negative) doubles, which order like integers, by
+// taking the sign bit of their difference (SSE2 has no 64-bit compare).
+static inline double radial_basis(double r2) {
+  const unsigned long long mantissa_mask = 0x000FFFFFFFFFFFFFULL;
+  const unsigned long long one_bits = 0x3FF0000000000000ULL;
+  const unsigned long long two52_bits = 0x4330000000000000ULL;
+  const unsigned long long sqrt2_bits = 0x3FF6A09E667F3BCDULL;
+  const unsigned long long tiny_bits = 0x16687E92154EF7ACULL; // 1e-200
+  unsigned long long bits;
+  std::memcpy(&bits, &r2, sizeof(bits));
+  unsigned long long m_bits = (bits & mantissa_mask) | one_bits;
+  unsigned long long e_bits = (bits >> 52) | two52_bits;
+  // if m > sqrt(2), halve m and increment e
+  unsigned long long high = -((sqrt2_bits - m_bits) >> 63);
+  m_bits -= high & (1ULL << 52);
+  e_bits += high & 1;
+  double m, e;
+  std::memcpy(&m, &m_bits, sizeof(m));
+  std::memcpy(&e, &e_bits, sizeof(e));
+  e -= 4503599627370496.0 + 1023; // 2^52 + exponent bias
+  double s = (m - 1) / (m + 1);
+  double s2 = s * s;
+  double series = 1.0/21;
+  series = series * s2 + 1.0/19;
+  series = series * s2 + 1.0/17;
+  series = series * s2 + 1.0/15;
+  series = series * s2 + 1.0/13;
+  series = series * s2 + 1.0/11;
+  series = series * s2 + 1.0/9;
+  series = series * s2 + 1.0/7;
+  series = series * s2 + 1.0/5;
+  series = series * s2 + 1.0/3;
+  series = series * s2 + 1;
+  double u = r2 * (e * 0.69314718055994531 + 2 * s * series);
+  // U is zero at r = 0; the above is also invalid for denormal r2.
+  unsigned long long u_bits;
+  std::memcpy(&u_bits, &u, sizeof(u_bits));
+  u_bits &= ((bits - tiny_bits) >> 63) - 1;
+  std::memcpy(&u, &u_bits, sizeof(u));
+  return u;
+}
+
+// Evaluate both coordinates of a thin-plate-spline warp over the rows
+// [start, stop) of the grid defined by the x and y coordinate vectors:
+//   f(x, y) = a1 + ax*x + ay*y + sum_k w_k U(|(x, y) - p_k|)
+// with U(r) = r^2 log(r) = r^2 log(r^2) / 2. The radial term is computed once
+// per landmark and pixel and shared between the two output planes. The
+// innermost loops run along a row over contiguous memory with no branches
+// or calls, so that the compiler can vectorize them.
+static void tps_grid(const double* points, const double* weights, int n,
+  const double* x, const double* y, int ny, int start, int stop,
+  double* out_x, double* out_y) {
+  // weights are stored as (n + 3, 2): the landmark weights, then the affine
+  // terms a1, ax, ay.
+  const double* affine = weights + 2*n;
+  for (int i = start; i < stop; i++) {
+    double* row_x = out_x + i*ny;
+    double* row_y = out_y + i*ny;
+    double xi = x[i];
+    for (int j = 0; j < ny; j++) {
+      row_x[j] = affine[0] + affine[2]*xi + affine[4]*y[j];
+      row_y[j] = affine[1] + affine[3]*xi + affine[5]*y[j];
+    }
+    for (int k = 0; k < n; k++) {
+      double dx = xi - points[2*k];
+      double dx2 = dx * dx;
+      double py = points[2*k + 1];
+      // fold the factor of 1/2 into the weights
+      double wx = weights[2*k] / 2;
+      double wy = weights[2*k + 1] / 2;
+      for (int j = 0; j < ny; j++) {
+        double dy = y[j] - py;
+        double r2 = dx2 + dy * dy;
+        double u = radial_basis(r2);
+        row_x[j] += wx * u;
+        row_y[j] += wy * u;
+      }
+    }
+  }
+}
+
+// Hierarchical approximation of thin-plate-spline kernel sums
+//   s_j = sum_k w_k U(|t_j - p_k|)
+// for many targets t_j and sources p_k, after the "black-box" fast multipole
+// method of Fong and Darve (J. Comput. Phys. 228:8712-8725, 2009). Sources
+// and targets are each sorted into a tree of boxes. Away from a box, the
+// kernel is a smooth function of position within the box, so it can be
+// interpolated from its values at the box's order x order Chebyshev nodes.
+// Thus the sources in a box can be replaced by weights at its nodes, and the
+// sum due to the sources far from a target box can be accumulated at that
+// box's nodes and then interpolated down the tree to the individual targets.
+// Two boxes are far from one another if the sum of their radii is less than
+// theta times the distance between their centers; the error decreases
+// roughly as theta^order.
+
+// Chebyshev nodes on [-1, 1], and the corresponding Lagrange basis
+// polynomials evaluated with the barycentric formula.
+class Chebyshev {
+  public:
+  Chebyshev(int order) : _order(order), _nodes(order), _lambda(order) {
+    for (int i = 0; i < order; i++) {
+      _nodes[i] = std::cos(3.14159265358979323846 * i / (order - 1));
+      _lambda[i] = (i % 2 ? -1 : 1) * (i == 0 || i == order - 1 ? 0.5 : 1);
+    }
+  }
+
+  double node(int i) const { return _nodes[i]; }
+
+  // Fill basis[i] with the value at t of the polynomial that is one at
+  // node i and zero at the other nodes.
+  void basis(double t, double* basis) const {
+    double sum = 0;
+    for (int i = 0; i < _order; i++) {
+      double difference = t - _nodes[i];
+      if (difference == 0) {
+        for (int j = 0; j < _order; j++) basis[j] = 0;
+        basis[i] = 1;
+        return;
+      }
+      basis[i] = _lambda[i] / difference;
+      sum += basis[i];
+    }
+    for (int i = 0; i < _order; i++) basis[i] /= sum;
+  }
+
+  private:
+  int _order;
+  std::vector<double> _nodes, _lambda;
+};
+
+// A box of the tree contains the points [begin, end) in the tree's sorted
+// order. Leaves have no children (child[0] == -1).
+struct Box {
+  double cx, cy, hx, hy, radius;
+  int begin, end;
+  int child[2];
+};
+
+class BelowSplit {
+  public:
+  BelowSplit(const double* points, int axis, double split)
+    : _points(points), _axis(axis), _split(split) {}
+  bool operator()(int i) const { return _points[2*i + _axis] < _split; }
+  private:
+  const double* _points;
+  int _axis;
+  double _split;
+};
+
+// Tree of boxes built by recursively splitting the bounding box of a set of
+// points across its longer side until no more than leaf_size points remain.
+// Boxes are stored with parents before children.
+class BoxTree {
+  public:
+  BoxTree(const double* points, int n, int leaf_size)
+    : index(n), x(n), y(n) {
+    for (int i = 0; i < n; i++) index[i] = i;
+    if (n > 0) build(points, 0, n, leaf_size);
+    for (int i = 0; i < n; i++) {
+      x[i] = points[2*index[i]];
+      y[i] = points[2*index[i] + 1];
+    }
+  }
+
+  std::vector<Box> boxes;
+  // index[i] is the original index of the i-th point in sorted order
+  std::vector<int> index;
+  std::vector<double> x, y;
+
+  private:
+  int build(const double* points, int begin, int end, int leaf_size) {
+    double x_min = points[2*index[begin]], x_max = x_min;
+    double y_min = points[2*index[begin] + 1], y_max = y_min;
+    for (int i = begin + 1; i < end; i++) {
+      double px = points[2*index[i]], py = points[2*index[i] + 1];
+      if (px < x_min) x_min = px;
+      if (px > x_max) x_max = px;
+      if (py < y_min) y_min = py;
+      if (py > y_max) y_max = py;
+    }
+    Box box;
+    box.cx = (x_min + x_max) / 2;
+    box.cy = (y_min + y_max) / 2;
+    box.hx = (x_max - x_min) / 2;
+    box.hy = (y_max - y_min) / 2;
+    box.radius = std::sqrt(box.hx * box.hx + box.hy * box.hy);
+    // Interpolation needs boxes of nonzero width in both directions.
+    double min_half = box.radius > 0 ? box.radius * 1e-3 : 1;
+    if (box.hx < min_half) box.hx = min_half;
+    if (box.hy < min_half) box.hy = min_half;
+    box.begin = begin;
+    box.end = end;
+    box.child[0] = box.child[1] = -1;
+    int b = boxes.size();
+    boxes.push_back(box);
+    if (end - begin > leaf_size) {
+      int axis = x_max - x_min >= y_max - y_min ? 0 : 1;
+      double split = axis ? (y_min + y_max) / 2 : (x_min + x_max) / 2;
+      int middle = std::partition(&index[0] + begin, &index[0] + end,
+        BelowSplit(points, axis, split)) - &index[0];
+      // if all the points coincide, no split is possible.
+      if (middle > begin && middle < end) {
+        int child0 = build(points, begin, middle, leaf_size);
+        int child1 = build(points, middle, end, leaf_size);
+        boxes[b].child[0] = child0;
+        boxes[b].child[1] = child1;
+      }
+    }
+    return b;
+  }
+};
+
+// Find the k points of the tree nearest to (x, y). 'nearest' is a max-heap
+// of (squared distance, sorted point index) pairs.
+typedef std::pair<double, int> Neighbor;
+static void nearest_neighbors(const BoxTree& tree, int b, double x, double y,
+  unsigned k, std::vector<Neighbor>& nearest) {
+  const Box& box = tree.boxes[b];
+  double dx = std::fabs(x - box.cx) - box.hx;
+  double dy = std::fabs(y - box.cy) - box.hy;
+  dx = dx > 0 ? dx : 0;
+  dy = dy > 0 ? dy : 0;
+  if (nearest.size() == k && dx * dx + dy * dy > nearest.front().first) return;
+  if (box.child[0] == -1) {
+    for (int i = box.begin; i < box.end; i++) {
+      double px = tree.x[i] - x, py = tree.y[i] - y;
+      double distance = px * px + py * py;
+      if (nearest.size() < k) {
+        nearest.push_back(Neighbor(distance, i));
+        std::push_heap(nearest.begin(), nearest.end());
+      } else if (distance < nearest.front().first) {
+        std::pop_heap(nearest.begin(), nearest.end());
+        nearest.back() = Neighbor(distance, i);
+        std::push_heap(nearest.begin(), nearest.end());
+      }
+    }
+    return;
+  }
+  // visit the child containing the point's side of the split first
+  int first = box.child[0], second = box.child[1];
+  const Box& child = tree.boxes[second];
+  if (std::fabs(x - child.cx) + std::fabs(y - child.cy) <
+      std::fabs(x - tree.boxes[first].cx) + std::fabs(y - tree.boxes[first].cy)) {
+    std::swap(first, second);
+  }
+  nearest_neighbors(tree, first, x, y, k, nearest);
+  nearest_neighbors(tree, second, x, y, k, nearest);
+}
+
+class KernelSums {
+  public:
+  // weights: shape (n, columns) array of the weights of each source.
+  KernelSums(const double* sources, const double* weights, int n, int columns,
+    const double* targets, int m, int order, double theta)
+    : _chebyshev(order), _order(order), _q(order * order), _columns(columns),
+      _theta(theta), _sources(sources, n, order * order),
+      _targets(targets, m, order * order) {
+    _weights.resize(n * columns);
+    for (int i = 0; i < n; i++) {
+      for (int c = 0; c < columns; c++) {
+        _weights[c*n + i] = weights[_sources.index[i]*columns + c];
+      }
+    }
+    _sums.assign(m * columns, 0);
+    _scratch.resize(n > _q ? n : _q);
+    node_positions(_sources, _source_x, _source_y);
+    node_positions(_targets, _target_x, _target_y);
+    _local.assign(_targets.boxes.size() * _q * columns, 0);
+    _has_local.assign(_targets.boxes.size(), false);
+    compute_proxy_weights();
+  }
+
+  // Write the shape (m, columns) array of kernel sums for each target.
+  void compute(double* sums) {
+    if (!_sources.boxes.empty() && !_targets.boxes.empty()) {
+      interact(0, 0);
+      downward_pass();
+    }
+    int m = _targets.index.size();
+    for (int j = 0; j < m; j++) {
+      for (int c = 0; c < _columns; c++) {
+        // radial_basis() omits the factor of 1/2 in U
+        sums[_targets.index[j]*_columns + c] = _sums[c*m + j] / 2;
+      }
+    }
+  }
+
+  private:
+  // Positions of the Chebyshev nodes of each box, as (box, i, j) arrays.
+  void node_positions(const BoxTree& tree, std::vector<double>& x, std::vector<double>& y) {
+    x.resize(tree.boxes.size() * _q);
+    y.resize(tree.boxes.size() * _q);
+    for (unsigned b = 0; b < tree.boxes.size(); b++) {
+      const Box& box = tree.boxes[b];
+      for (int i = 0; i < _order; i++) {
+        for (int j = 0; j < _order; j++) {
+          x[b*_q + i*_order + j] = box.cx + box.hx * _chebyshev.node(i);
+          y[b*_q + i*_order + j] = box.cy + box.hy * _chebyshev.node(j);
+        }
+      }
+    }
+  }
+
+  // The weights at the Chebyshev nodes of a source box are the source
+  // weights times the basis polynomials at the source positions. They are
+  // only used for boxes with more sources than nodes.
+  void compute_proxy_weights() {
+    int n = _sources.index.size();
+    _proxy_weights.assign(_sources.boxes.size() * _q * _columns, 0);
+    std::vector<double> basis_x(_order), basis_y(_order);
+    for (unsigned b = 0; b < _sources.boxes.size(); b++) {
+      const Box& box = _sources.boxes[b];
+      if (box.end - box.begin <= _q) continue;
+      double* proxy = &_proxy_weights[b * _q * _columns];
+      for (int k = box.begin; k < box.end; k++) {
+        _chebyshev.basis((_sources.x[k] - box.cx) / box.hx, &basis_x[0]);
+        _chebyshev.basis((_sources.y[k] - box.cy) / box.hy, &basis_y[0]);
+        for (int c = 0; c < _columns; c++) {
+          double w = _weights[c*n + k];
+          for (int i = 0; i < _order; i++) {
+            double wx = w * basis_x[i];
+            for (int j = 0; j < _order; j++) {
+              proxy[c*_q + i*_order + j] += wx * basis_y[j];
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Add to out[c * out_stride] the sum over the 'count' sources at (x, y)
+  // of weights[c * weights_stride + k] * radial_basis(r2), for each column.
+  void add_sums(double tx, double ty, const double* x, const double* y,
+    const double* weights, int weights_stride, int count, double* out,
+    int out_stride) {
+    double* u = &_scratch[0];
+    for (int k = 0; k < count; k++) {
+      double dx = tx - x[k];
+      double dy = ty - y[k];
+      u[k] = radial_basis(dx * dx + dy * dy);
+    }
+    for (int c = 0; c < _columns; c++) {
+      const double* w = weights + c * weights_stride;
+      double sum = 0;
+      for (int k = 0; k < count; k++) sum += u[k] * w[k];
+      out[c * out_stride] += sum;
+    }
+  }
+
+  // Dual traversal of the target and source trees.
+  void interact(int t, int s) {
+    const Box& target = _targets.boxes[t];
+    const Box& source = _sources.boxes[s];
+    double dx = target.cx - source.cx;
+    double dy = target.cy - source.cy;
+    double distance = std::sqrt(dx * dx + dy * dy);
+    if (target.radius + source.radius < _theta * distance) {
+      far_field(t, s);
+      return;
+    }
+    bool target_leaf = target.child[0] == -1;
+    bool source_leaf = source.child[0] == -1;
+    if (target_leaf && source_leaf) {
+      direct(t, s);
+    } else if (source_leaf || (!target_leaf && target.radius >= source.radius)) {
+      int child0 = target.child[0], child1 = target.child[1];
+      interact(child0, s);
+      interact(child1, s);
+    } else {
+      int child0 = source.child[0], child1 = source.child[1];
+      interact(t, child0);
+      interact(t, child1);
+    }
+  }
+
+  // Sources to targets.
+  void direct(int t, int s) {
+    const Box& target = _targets.boxes[t];
+    const Box& source = _sources.boxes[s];
+    int n = _sources.index.size(), m = _targets.index.size();
+    for (int j = target.begin; j < target.end; j++) {
+      add_sums(_targets.x[j], _targets.y[j], &_sources.x[source.begin],
+        &_sources.y[source.begin], &_weights[source.begin], n,
+        source.end - source.begin, &_sums[j], m);
+    }
+  }
+
+  // Well-separated boxes: use the source box's Chebyshev nodes instead of
+  // its sources, and/or accumulate at the target box's nodes instead of at
+  // its targets, whichever requires the fewest kernel evaluations.
+  void far_field(int t, int s) {
+    const Box& target = _targets.boxes[t];
+    const Box& source = _sources.boxes[s];
+    int n = _sources.index.size(), m = _targets.index.size();
+    int sources = source.end - source.begin, targets = target.end - target.begin;
+    bool use_proxies = sources > _q;
+    bool use_local = targets > _q;
+    if (!use_local) {
+      if (!use_proxies) {
+        direct(t, s);
+        return;
+      }
+      const double* proxy = &_proxy_weights[s * _q * _columns];
+      for (int j = target.begin; j < target.end; j++) {
+        add_sums(_targets.x[j], _targets.y[j], &_source_x[s * _q], &_source_y[s * _q],
+          proxy, _q, _q, &_sums[j], m);
+      }
+      return;
+    }
+    double* local = &_local[t * _q * _columns];
+    _has_local[t] = true;
+    for (int a = 0; a < _q; a++) {
+      double tx = _target_x[t * _q + a], ty = _target_y[t * _q + a];
+      if (use_proxies) {
+        add_sums(tx, ty, &_source_x[s * _q], &_source_y[s * _q],
+          &_proxy_weights[s * _q * _columns], _q, _q, local + a, _q);
+      } else {
+        add_sums(tx, ty, &_sources.x[source.begin], &_sources.y[source.begin],
+          &_weights[source.begin], n, sources, local + a, _q);
+      }
+    }
+  }
+
+  // Interpolate the sums at each target box's Chebyshev nodes down to its
+  // children's nodes, and finally to the targets in the leaves.
+  void downward_pass() {
+    int m = _targets.index.size();
+    std::vector<double> basis_x(_order * _order), basis_y(_order * _order);
+    std::vector<double> partial(_q);
+    for (unsigned t = 0; t < _targets.boxes.size(); t++) {
+      if (!_has_local[t]) continue;
+      const Box& box = _targets.boxes[t];
+      const double* local = &_local[t * _q * _columns];
+      if (box.child[0] == -1) {
+        for (int j = box.begin; j < box.end; j++) {
+          _chebyshev.basis((_targets.x[j] - box.cx) / box.hx, &basis_x[0]);
+          _chebyshev.basis((_targets.y[j] - box.cy) / box.hy, &basis_y[0]);
+          for (int c = 0; c < _columns; c++) {
+            double sum = 0;
+            for (int a = 0; a < _order; a++) {
+              double row = 0;
+              for (int b = 0; b < _order; b++) {
+                row += basis_y[b] * local[c*_q + a*_order + b];
+              }
+              sum += basis_x[a] * row;
+            }
+            _sums[c*m + j] += sum;
+          }
+        }
+        continue;
+      }
+      for (int k = 0; k < 2; k++) {
+        int child = box.child[k];
+        const Box& child_box = _targets.boxes[child];
+        // basis_x[i*order + a]: parent basis polynomial a at child node i
+        for (int i = 0; i < _order; i++) {
+          _chebyshev.basis((child_box.cx + child_box.hx * _chebyshev.node(i) - box.cx) / box.hx,
+            &basis_x[i * _order]);
+          _chebyshev.basis((child_box.cy + child_box.hy * _chebyshev.node(i) - box.cy) / box.hy,
+            &basis_y[i * _order]);
+        }
+        double* child_local = &_local[child * _q * _columns];
+        _has_local[child] = true;
+        for (int c = 0; c < _columns; c++) {
+          // interpolate along y, then along x
+          for (int a = 0; a < _order; a++) {
+            for (int j = 0; j < _order; j++) {
+              double sum = 0;
+              for (int b = 0; b < _order; b++) {
+                sum += basis_y[j*_order + b] * local[c*_q + a*_order + b];
+              }
+              partial[a*_order + j] = sum;
+            }
+          }
+          for (int i = 0; i < _order; i++) {
+            for (int j = 0; j < _order; j++) {
+              double sum = 0;
+              for (int a = 0; a < _order; a++) {
+                sum += basis_x[i*_order + a] * partial[a*_order + j];
+              }
+              child_local[c*_q + i*_order + j] += sum;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  Chebyshev _chebyshev;
+  int _order, _q, _columns;
+  double _theta;
+  BoxTree _sources, _targets;
+  // weights, sums, proxy weights and local sums are stored column by column
+  std::vector<double> _weights, _sums, _proxy_weights, _local, _scratch;
+  std::vector<double> _source_x, _source_y, _target_x, _target_y;
+  std::vector<bool> _has_local;
+};
+
+// As tps_grid(), but with the radial-basis sums approximated by KernelSums.
+static void approximate_tps_grid(const double* points, const double* weights,
+  int n, const double* x, const double* y, int ny, int start, int stop,
+  int order, double theta, double* out_x, double* out_y) {
+  int m = (stop - start) * ny;
+  std::vector<double> targets(2 * m), sums(2 * m);
+  for (int i = start; i < stop; i++) {
+    for (int j = 0; j < ny; j++) {
+      targets[2*((i - start)*ny + j)] = x[i];
+      targets[2*((i - start)*ny + j) + 1] = y[j];
+    }
+  }
+  if (m > 0) {
+    KernelSums kernel_sums(points, weights, n, 2, &targets[0], m, order, theta);
+    kernel_sums.compute(&sums[0]);
+  }
+  const double* affine = weights + 2*n;
+  for (int i = start; i < stop; i++) {
+    double* row_x = out_x + i*ny;
+    double* row_y = out_y + i*ny;
+    const double* row_sums = &sums[0] + 2*(i - start)*ny;
+    for (int j = 0; j < ny; j++) {
+      row_x[j] = affine[0] + affine[2]*x[i] + affine[4]*y[j] + row_sums[2*j];
+      row_y[j] = affine[1] + affine[3]*x[i] + affine[5]*y[j] + row_sums[2*j + 1];
+    }
+  }
+}
+
+static char tps_grid_doc[] =
+"tps_grid(points, coefficients, x, y, output, start, stop, order=0, theta=0.5)\n\
+\n\
+points: shape (n, 2) array of landmark points.\n\
+coefficients: shape (n + 3, 2) array of thin-plate-spline coefficients for\n\
+   the x and y coordinates of the warp: the n landmark weights followed by\n\
+   the constant, x and y affine terms.\n\
+x, y: 1D arrays of the grid coordinates along each axis.\n\
+output: contiguous double array of shape (2, len(x), len(y)) into which the\n\
+   warped x and y coordinates of the grid points are written.\n\
+start, stop: range of grid rows (indices into x) to evaluate.\n\
+order: if zero, the warp is evaluated exactly. Otherwise, the sum over the\n\
+   landmarks is approximated with a fast multipole method using order x order\n\
+   Chebyshev interpolation nodes per box (see kernel_sums).\n\
+theta: boxes of landmarks and grid points are treated directly unless the\n\
+   sum of their radii is less than theta times their distance.\n\
+\n\
+Several threads may fill disjoint row ranges of the same output array at\n\
+once, since the global interpreter lock is released during the calculation.";
+
+static PyObject*
+tps_grid(PyObject *self, PyObject *args)
+{
+  PyObject* points_array = NULL;
+  PyObject* coeffs_array = NULL;
+  PyObject* x_array = NULL;
+  PyObject* y_array = NULL;
+  PyArrayObject* output_array;
+  int start, stop, n, nx, ny;
+  int order = 0;
+  double theta = 0.5;
+  double *points, *coeffs, *x, *y, *out;
+
+  if (!PyArg_ParseTuple(args, "OOOOO!ii|id:tps_grid", &points_array, &coeffs_array,
+    &x_array, &y_array, &PyArray_Type, &output_array, &start, &stop, &order, &theta))
+    return NULL;
+
+  points_array = PyArray_FromAny(points_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  coeffs_array = PyArray_FromAny(coeffs_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  x_array = PyArray_FromAny(x_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  y_array = PyArray_FromAny(y_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  if (!points_array || !coeffs_array || !x_array || !y_array) goto fail;
+  n = PyArray_DIM(points_array, 0);
+  nx = PyArray_DIM(x_array, 0);
+  ny = PyArray_DIM(y_array, 0);
+  if (PyArray_DIM(points_array, 1) != 2 || PyArray_DIM(coeffs_array, 0) != n + 3 ||
+      PyArray_DIM(coeffs_array, 1) != 2) {
+    PyErr_SetString(PyExc_ValueError, "points must be shape (n, 2) and coefficients shape (n + 3, 2).");
+    goto fail;
+  }
+  if (PyArray_TYPE(output_array) != NPY_DOUBLE || !PyArray_ISCARRAY(output_array) ||
+      PyArray_NDIM(output_array) != 3 || PyArray_DIM(output_array, 0) != 2 ||
+      PyArray_DIM(output_array, 1) != nx || PyArray_DIM(output_array, 2) != ny) {
+    PyErr_SetString(PyExc_ValueError, "output must be a contiguous double array of shape (2, len(x), len(y)).");
+    goto fail;
+  }
+  if (start < 0 || stop > nx || start > stop) {
+    PyErr_SetString(PyExc_ValueError, "Invalid row range.");
+    goto fail;
+  }
+  if (order == 1 || order < 0 || theta <= 0 || theta >= 1) {
+    PyErr_SetString(PyExc_ValueError, "order must be 0 or at least 2, and theta must be between 0 and 1.");
+    goto fail;
+  }
+  points = (double *) PyArray_DATA(points_array);
+  coeffs = (double *) PyArray_DATA(coeffs_array);
+  x = (double *) PyArray_DATA(x_array);
+  y = (double *) PyArray_DATA(y_array);
+  out = (double *) PyArray_DATA(output_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  if (order == 0) {
+    tps_grid(points, coeffs, n, x, y, ny, start, stop, out, out + nx*ny);
+  } else {
+    approximate_tps_grid(points, coeffs, n, x, y, ny, start, stop, order, theta,
+      out, out + nx*ny);
+  }
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(y_array);
+  Py_DECREF(x_array);
+  Py_DECREF(coeffs_array);
+  Py_DECREF(points_array);
+  Py_RETURN_NONE;
+
+  fail:
+  Py_XDECREF(y_array);
+  Py_XDECREF(x_array);
+  Py_XDECREF(coeffs_array);
+  Py_XDECREF(points_array);
+  return NULL;
+}
+
+static char kernel_sums_doc[] =
+"kernel_sums(sources, weights, targets, order, theta) -> sums\n\
+\n\
+sources: shape (n, 2) array of source points.\n\
+weights: shape (n, c) array of c weights for each source.\n\
+targets: shape (m, 2) array of target points.\n\
+order: number of Chebyshev nodes (at least 2) along each side of the boxes\n\
+   into which the sources and targets are sorted.\n\
+theta: boxes are treated directly unless the sum of their radii is less\n\
+   than theta times their distance.\n\
+\n\
+Returns the shape (m, c) array of the sums over the sources p of\n\
+w U(|t - p|) for each target t and column of weights w, where\n\
+U(r) = r^2 log(r) is the thin-plate-spline kernel. The sums are\n\
+approximated with the kernel-independent fast multipole method of Fong and\n\
+Darve, for which the error falls roughly as theta^order. The global\n\
+interpreter lock is released during the calculation.";
+
+static PyObject*
+kernel_sums(PyObject *self, PyObject *args)
+{
+  PyObject* sources_array = NULL;
+  PyObject* weights_array = NULL;
+  PyObject* targets_array = NULL;
+  PyObject* sums_array = NULL;
+  int order, n, m, columns;
+  double theta;
+  npy_intp sums_dims[2];
+  double *sources, *weights, *targets, *sums;
+
+  if (!PyArg_ParseTuple(args, "OOOid:kernel_sums", &sources_array, &weights_array,
+    &targets_array, &order, &theta))
+    return NULL;
+
+  sources_array = PyArray_FromAny(sources_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  weights_array = PyArray_FromAny(weights_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  targets_array = PyArray_FromAny(targets_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  if (!sources_array || !weights_array || !targets_array) goto fail;
+  n = PyArray_DIM(sources_array, 0);
+  m = PyArray_DIM(targets_array, 0);
+  columns = PyArray_DIM(weights_array, 1);
+  if (PyArray_DIM(sources_array, 1) != 2 || PyArray_DIM(targets_array, 1) != 2 ||
+      PyArray_DIM(weights_array, 0) != n) {
+    PyErr_SetString(PyExc_ValueError, "sources and targets must be shape (n, 2) and (m, 2), and weights shape (n, c).");
+    goto fail;
+  }
+  if (order < 2 || theta <= 0 || theta >= 1) {
+    PyErr_SetString(PyExc_ValueError, "order must be at least 2, and theta must be between 0 and 1.");
+    goto fail;
+  }
+  sums_dims[0] = m;
+  sums_dims[1] = columns;
+  sums_array = PyArray_SimpleNew(2, sums_dims, NPY_DOUBLE);
+  if (!sums_array) goto fail;
+  sources = (double *) PyArray_DATA(sources_array);
+  weights = (double *) PyArray_DATA(weights_array);
+  targets = (double *) PyArray_DATA(targets_array);
+  sums = (double *) PyArray_DATA(sums_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  KernelSums kernel_sums(sources, weights, n, columns, targets, m, order, theta);
+  kernel_sums.compute(sums);
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(targets_array);
+  Py_DECREF(weights_array);
+  Py_DECREF(sources_array);
+  return sums_array;
+
+  fail:
+  Py_XDECREF(sums_array);
+  Py_XDECREF(targets_array);
+  Py_XDECREF(weights_array);
+  Py_XDECREF(sources_array);
+  return NULL;
+}
+
+static char nearest_neighbors_doc[] =
+"nearest_neighbors(points, k) -> indices\n\
+\n\
+points: shape (n, 2) array of points.\n\
+k: number of neighbors to find (at most n).\n\
+\n\
+Returns the shape (n, k) array of the indices of the k points nearest to\n\
+each point (including the point itself), in order of increasing distance.";
+
+static PyObject*
+nearest_neighbors(PyObject *self, PyObject *args)
+{
+  PyObject* points_array = NULL;
+  PyObject* indices_array = NULL;
+  int k, n;
+  npy_intp indices_dims[2];
+  double *points;
+  int *indices;
+
+  if (!PyArg_ParseTuple(args, "Oi:nearest_neighbors", &points_array, &k))
+    return NULL;
+
+  points_array = PyArray_FromAny(points_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  if (!points_array) goto fail;
+  n = PyArray_DIM(points_array, 0);
+  if (PyArray_DIM(points_array, 1) != 2) {
+    PyErr_SetString(PyExc_ValueError, "points must be shape (n, 2).");
+    goto fail;
+  }
+  if (k < 1 || k > n) {
+    PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of points.");
+    goto fail;
+  }
+  indices_dims[0] = n;
+  indices_dims[1] = k;
+  indices_array = PyArray_SimpleNew(2, indices_dims, NPY_INT);
+  if (!indices_array) goto fail;
+  points = (double *) PyArray_DATA(points_array);
+  indices = (int *) PyArray_DATA(indices_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  BoxTree tree(points, n, 16);
+  std::vector<Neighbor> nearest;
+  for (int i = 0; i < n; i++) {
+    nearest.clear();
+    nearest_neighbors(tree, 0, points[2*i], points[2*i + 1], k, nearest);
+    std::sort_heap(nearest.begin(), nearest.end());
+    for (int j = 0; j < k; j++) {
+      indices[i*k + j] = tree.index[nearest[j].second];
+    }
+  }
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(points_array);
+  return indices_array;
+
+  fail:
+  Py_XDECREF(indices_array);
+  Py_XDECREF(points_array);
+  return NULL;
+}
+
+// Fill rows [start, start + rows) of a finely-sampled coordinate grid by
+// bilinear interpolation of a coarse grid of shape (gx, gy): fine grid point
+// (i, j) lies at coarse grid position ((gx-1)*i/x_span, (gy-1)*j/y_span).
+static void bilinear_grid(const double* grid, int gx, int gy, double x_span,
+  double y_span, int start, int rows, int ny, double* out) {
+  const double* grid_x = grid;
+  const double* grid_y = grid + gx*gy;
+  double* out_x = out;
+  double* out_y = out + rows*ny;
+  std::vector<int> y_indices(ny), y_next(ny);
+  std::vector<double> y_fracs(ny);
+  for (int j = 0; j < ny; j++) {
+    double position = (gy - 1) * j / y_span;
+    y_indices[j] = (int) position;
+    y_fracs[j] = position - y_indices[j];
+    y_next[j] = y_indices[j] + 1 < gy ? y_indices[j] + 1 : gy - 1;
+  }
+  for (int i = 0; i < rows; i++) {
+    double position = (gx - 1) * (start + i) / x_span;
+    int x_index = (int) position;
+    double x_frac = position - x_index;
+    int x_next = x_index + 1 < gx ? x_index + 1 : gx - 1;
+    double x1 = 1 - x_frac;
+    for (int j = 0; j < ny; j++) {
+      double y_frac = y_fracs[j], y1 = 1 - y_frac;
+      int i00 = x_index*gy + y_indices[j], i01 = x_index*gy + y_next[j];
+      int i10 = x_next*gy + y_indices[j], i11 = x_next*gy + y_next[j];
+      out_x[i*ny + j] = grid_x[i00]*x1*y1 + grid_x[i01]*x1*y_frac +
+        grid_x[i10]*x_frac*y1 + grid_x[i11]*x_frac*y_frac;
+      out_y[i*ny + j] = grid_y[i00]*x1*y1 + grid_y[i01]*x1*y_frac +
+        grid_y[i10]*x_frac*y1 + grid_y[i11]*x_frac*y_frac;
+    }
+  }
+}
+
+static char bilinear_grid_doc[] =
+"bilinear_grid(grid, x_span, y_span, start, output)\n\
+\n\
+grid: shape (2, gx, gy) array of x and y coordinates on a coarse grid.\n\
+x_span, y_span: the coarse grid covers rows 0 to x_span and columns 0 to\n\
+   y_span (inclusive) of the fine grid.\n\
+start: first row of the fine grid to calculate.\n\
+output: contiguous double array of shape (2, rows, ny) into which the x and\n\
+   y coordinates of rows [start, start + rows) of the fine grid are written.\n\
+\n\
+Fine grid point (i, j) is bilinearly interpolated from the coarse grid at\n\
+position ((gx-1)*i/x_span, (gy-1)*j/y_span). The global interpreter lock is\n\
+released during the calculation.";
+
+static PyObject*
+bilinear_grid(PyObject *self, PyObject *args)
+{
+  PyObject* grid_array = NULL;
+  PyArrayObject* output_array;
+  double x_span, y_span;
+  int start, gx, gy, rows, ny;
+  double *grid, *out;
+
+  if (!PyArg_ParseTuple(args, "OddiO!:bilinear_grid", &grid_array, &x_span, &y_span,
+    &start, &PyArray_Type, &output_array))
+    return NULL;
+
+  grid_array = PyArray_FromAny(grid_array, PyArray_DescrFromType(NPY_DOUBLE),
+    3, 3, NPY_CARRAY, NULL);
+  if (!grid_array) goto fail;
+  gx = PyArray_DIM(grid_array, 1);
+  gy = PyArray_DIM(grid_array, 2);
+  if (PyArray_DIM(grid_array, 0) != 2 || gx < 1 || gy < 1) {
+    PyErr_SetString(PyExc_ValueError, "grid must be a non-empty array of shape (2, gx, gy).");
+    goto fail;
+  }
+  if (PyArray_TYPE(output_array) != NPY_DOUBLE || !PyArray_ISCARRAY(output_array) ||
+      PyArray_NDIM(output_array) != 3 || PyArray_DIM(output_array, 0) != 2) {
+    PyErr_SetString(PyExc_ValueError, "output must be a contiguous double array of shape (2, rows, ny).");
+    goto fail;
+  }
+  if (x_span <= 0 || y_span <= 0 || start < 0) {
+    PyErr_SetString(PyExc_ValueError, "The spans must be positive and start non-negative.");
+    goto fail;
+  }
+  rows = PyArray_DIM(output_array, 1);
+  ny = PyArray_DIM(output_array, 2);
+  if (start + rows - 1 > x_span || ny - 1 > y_span) {
+    PyErr_SetString(PyExc_ValueError, "The output rows and columns must lie within the spans.");
+    goto fail;
+  }
+  grid = (double *) PyArray_DATA(grid_array);
+  out = (double *) PyArray_DATA(output_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  bilinear_grid(grid, gx, gy, x_span, y_span, start, rows, ny, out);
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(grid_array);
+  Py_RETURN_NONE;
+
+  fail:
+  Py_XDECREF(grid_array);
+  return NULL;
+}
+
+// Delaunay triangulation of a set of 2D points by the Bowyer-Watson
+// algorithm: each point is inserted in turn by removing the triangles whose
+// circumcircles contain it, and joining the point to the boundary of the
+// resulting cavity. The points are inserted in order of x; a triangle whose
+// circumcircle lies entirely to the left of the current point can never
+// contain a later point, and so is set aside, which keeps the list of
+// triangles that must be searched short. Duplicate points are skipped.
+// The vertices of each output triangle are in counterclockwise order.
+struct Triangle {
+  int v[3];
+  double cx, cy, r2;
+};
+
+static Triangle make_triangle(int a, int b, int c, const std::vector<double>& px,
+  const std::vector<double>& py) {
+  Triangle triangle;
+  triangle.v[0] = a; triangle.v[1] = b; triangle.v[2] = c;
+  // circumcenter, relative to vertex a
+  double bx = px[b] - px[a], by = py[b] - py[a];
+  double cx = px[c] - px[a], cy = py[c] - py[a];
+  double d = 2 * (bx*cy - by*cx);
+  double b2 = bx*bx + by*by, c2 = cx*cx + cy*cy;
+  double ux = (cy*b2 - by*c2) / d, uy = (bx*c2 - cx*b2) / d;
+  triangle.cx = px[a] + ux;
+  triangle.cy = py[a] + uy;
+  triangle.r2 = ux*ux + uy*uy;
+  return triangle;
+}
+
+// Removing the triangles that touch the super-triangle can leave slivers of
+// the convex hull of the points uncovered (where a point just inside the
+// hull lies within the circumcircle of a triangle including a super-triangle
+// vertex). These are filled in by walking the boundary of the triangulation
+// counterclockwise and cutting off each reflex vertex with a new triangle
+// until the boundary is convex.
+static void fill_hull(const std::vector<double>& px, const std::vector<double>& py,
+  int n, std::vector<int>& triangles) {
+  int n_triangles = triangles.size() / 3;
+  std::vector<long long> edges(3*n_triangles);
+  for (int t = 0; t < n_triangles; t++) {
+    for (int e = 0; e < 3; e++) {
+      edges[3*t + e] = (long long) triangles[3*t + e] * n + triangles[3*t + (e + 1) % 3];
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  // boundary edges are those whose reverse is not present
+  std::vector<int> next(n, -1);
+  int first = -1;
+  for (int i = 0; i < 3*n_triangles; i++) {
+    int a = edges[i] / n, b = edges[i] % n;
+    if (!std::binary_search(edges.begin(), edges.end(), (long long) b * n + a)) {
+      next[a] = b;
+      first = a;
+    }
+  }
+  if (first < 0) return;
+  std::vector<int> boundary;
+  int v = first;
+  do {
+    boundary.push_back(v);
+    v = next[v];
+  } while (v != first && v >= 0 && boundary.size() <= (unsigned) n);
+  bool changed = true;
+  while (changed && boundary.size() > 3) {
+    changed = false;
+    for (unsigned i = 0; i < boundary.size() && boundary.size() > 3; i++) {
+      int a = boundary[(i + boundary.size() - 1) % boundary.size()];
+      int b = boundary[i];
+      int c = boundary[(i + 1) % boundary.size()];
+      if ((px[b] - px[a])*(py[c] - py[b]) - (py[b] - py[a])*(px[c] - px[b]) < 0) {
+        triangles.push_back(a);
+        triangles.push_back(c);
+        triangles.push_back(b);
+        boundary.erase(boundary.begin() + i);
+        changed = true;
+        if (i > 0) i--;
+        i--;
+      }
+    }
+  }
+}
+
+class PointOrder {
+  public:
+  PointOrder(const double* points) : _points(points) {}
+  bool operator()(int a, int b) const {
+    const double* p = _points + 2*a;
+    const double* q = _points + 2*b;
+    return p[0] < q[0] || (p[0] == q[0] && p[1] < q[1]);
+  }
+  private:
+  const double* _points;
+};
+
+static void delaunay(const double* points, int n, std::vector<int>& triangles) {
+  triangles.clear();
+  if (n < 3) return;
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), PointOrder(points));
+  // Enclose the points in a "super-triangle" with vertices n, n+1, n+2,
+  // far enough away that it does not distort the hull of the triangulation.
+  std::vector<double> px(n + 3), py(n + 3);
+  double x_lo = points[0], x_hi = points[0], y_lo = points[1], y_hi = points[1];
+  for (int i = 0; i < n; i++) {
+    px[i] = points[2*i];
+    py[i] = points[2*i + 1];
+    x_lo = std::min(x_lo, px[i]); x_hi = std::max(x_hi, px[i]);
+    y_lo = std::min(y_lo, py[i]); y_hi = std::max(y_hi, py[i]);
+  }
+  double size = std::max(x_hi - x_lo, y_hi - y_lo);
+  if (size == 0) return;
+  double mx = (x_lo + x_hi) / 2, my = (y_lo + y_hi) / 2;
+  px[n] = mx - 1000*size; py[n] = my - 1000*size;
+  px[n + 1] = mx + 1000*size; py[n + 1] = my - 1000*size;
+  px[n + 2] = mx; py[n + 2] = my + 1000*size;
+
+  std::vector<Triangle> active, done;
+  std::vector<int> edges;
+  active.push_back(make_triangle(n, n + 1, n + 2, px, py));
+  for (int k = 0; k < n; k++) {
+    int p = order[k];
+    if (k > 0 && px[p] == px[order[k - 1]] && py[p] == py[order[k - 1]]) continue;
+    edges.clear();
+    for (unsigned t = 0; t < active.size();) {
+      const Triangle& triangle = active[t];
+      double dx = px[p] - triangle.cx, dy = py[p] - triangle.cy;
+      if (dx > 0 && dx*dx > triangle.r2) {
+        done.push_back(triangle);
+      } else if (dx*dx + dy*dy < triangle.r2) {
+        for (int e = 0; e < 3; e++) {
+          edges.push_back(triangle.v[e]);
+          edges.push_back(triangle.v[(e + 1) % 3]);
+        }
+      } else {
+        t++;
+        continue;
+      }
+      active[t] = active.back();
+      active.pop_back();
+    }
+    // Edges shared by two removed triangles appear once in each direction,
+    // and are interior to the cavity; the rest form its boundary.
+    int n_edges = edges.size() / 2;
+    for (int e = 0; e < n_edges; e++) {
+      int a = edges[2*e], b = edges[2*e + 1];
+      bool shared = false;
+      for (int f = 0; f < n_edges && !shared; f++) {
+        shared = edges[2*f] == b && edges[2*f + 1] == a;
+      }
+      if (!shared) active.push_back(make_triangle(a, b, p, px, py));
+    }
+  }
+  done.insert(done.end(), active.begin(), active.end());
+  for (unsigned t = 0; t < done.size(); t++) {
+    const int* v = done[t].v;
+    if (v[0] < n && v[1] < n && v[2] < n) {
+      triangles.insert(triangles.end(), v, v + 3);
+    }
+  }
+  fill_hull(px, py, n, triangles);
+}
+
+static char delaunay_doc[] =
+"delaunay(points) -> triangles\n\
+\n\
+points: shape (n, 2) array of points.\n\
+\n\
+Returns the shape (m, 3) array of the indices of the vertices of the\n\
+triangles of the Delaunay triangulation of the points, each listed in\n\
+counterclockwise order. Duplicate points are ignored.";
+
+static PyObject*
+delaunay(PyObject *self, PyObject *args)
+{
+  PyObject* points_array = NULL;
+  PyObject* triangles_array = NULL;
+  int n;
+  npy_intp triangles_dims[2];
+  std::vector<int> triangles;
+
+  if (!PyArg_ParseTuple(args, "O:delaunay", &points_array))
+    return NULL;
+
+  points_array = PyArray_FromAny(points_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  if (!points_array) goto fail;
+  n = PyArray_DIM(points_array, 0);
+  if (PyArray_DIM(points_array, 1) != 2) {
+    PyErr_SetString(PyExc_ValueError, "points must be shape (n, 2).");
+    goto fail;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  delaunay((double *) PyArray_DATA(points_array), n, triangles);
+  Py_END_ALLOW_THREADS
+
+  triangles_dims[0] = triangles.size() / 3;
+  triangles_dims[1] = 3;
+  triangles_array = PyArray_SimpleNew(2, triangles_dims, NPY_INT);
+  if (!triangles_array) goto fail;
+  if (!triangles.empty()) {
+    std::memcpy(PyArray_DATA(triangles_array), &triangles[0], triangles.size()*sizeof(int));
+  }
+  Py_DECREF(points_array);
+  return triangles_array;
+
+  fail:
+  Py_XDECREF(triangles_array);
+  Py_XDECREF(points_array);
+  return NULL;
+}
+
+// Fill rows [start, start + rows) of a grid of output pixels, where pixel
+// (i, j) lies at (x0 + i, y0 + j), with the coordinates they map to under
+// the piecewise-affine map that takes each (counterclockwise) triangle of
+// the 'to' points to the corresponding triangle of the 'from' points.
+// Rather than locating each pixel in the triangulation, each triangle is
+// scan-converted: for each row that it spans, the columns inside it are
+// found by clipping against its three edges, and filled in directly. Pixels
+// in no triangle are given the coordinates (-1, -1), outside any image.
+static void affine_grid(const double* from, const double* to, const int* triangles,
+  int n_triangles, double x0, double y0, int start, int rows, int ny, double* out) {
+  const double epsilon = 1e-9;
+  double* out_x = out;
+  double* out_y = out + rows*ny;
+  std::fill(out, out + 2*rows*ny, -1.0);
+  x0 += start;
+  for (int t = 0; t < n_triangles; t++) {
+    const int* v = triangles + 3*t;
+    double ax = to[2*v[0]], ay = to[2*v[0] + 1];
+    double bx = to[2*v[1]] - ax, by = to[2*v[1] + 1] - ay;
+    double cx = to[2*v[2]] - ax, cy = to[2*v[2] + 1] - ay;
+    double d = bx*cy - by*cx;
+    if (!(d > 0)) continue;
+    // barycentric coordinates (u, w) of a point (x, y) relative to a are
+    // u = ((x-ax)*cy - cx*(y-ay)) / d and w = (bx*(y-ay) - (x-ax)*by) / d;
+    // the mapped point is from[v0] + u*(from[v1]-from[v0]) + w*(from[v2]-from[v0])
+    double fx = from[2*v[0]], fy = from[2*v[0] + 1];
+    double fbx = from[2*v[1]] - fx, fby = from[2*v[1] + 1] - fy;
+    double fcx = from[2*v[2]] - fx, fcy = from[2*v[2] + 1] - fy;
+    double lo = std::min(0.0, std::min(bx, cx)), hi = std::max(0.0, std::max(bx, cx));
+    int i_lo = std::max(0, (int) std::ceil(ax + lo - x0 - epsilon));
+    int i_hi = std::min(rows - 1, (int) std::floor(ax + hi - x0 + epsilon));
+    for (int i = i_lo; i <= i_hi; i++) {
+      double x = x0 + i - ax;
+      // clip the row to the inside (left) of each edge p -> q:
+      // (qx-px)*(y-py) - (qy-py)*(x-px) >= 0
+      double y_lo = -HUGE_VAL, y_hi = HUGE_VAL;
+      double ex[4] = {0, bx, cx, 0}, ey[4] = {0, by, cy, 0};
+      for (int e = 0; e < 3; e++) {
+        double dx = ex[e + 1] - ex[e], dy = ey[e + 1] - ey[e];
+        double bound = dy*(x - ex[e]);
+        if (dx > 0) y_lo = std::max(y_lo, ey[e] + bound / dx);
+        else if (dx < 0) y_hi = std::min(y_hi, ey[e] + bound / dx);
+        else if (bound > epsilon*std::fabs(dy)) y_hi = -HUGE_VAL;
+      }
+      if (!(y_lo <= y_hi)) continue;
+      int j_lo = std::max(0, (int) std::ceil(std::max(ay + y_lo - y0, -1.0) - epsilon));
+      int j_hi = std::min(ny - 1, (int) std::floor(std::min(ay + y_hi - y0, (double) ny) + epsilon));
+      double u_x = x*cy / d, w_x = -x*by / d;
+      for (int j = j_lo; j <= j_hi; j++) {
+        double y = y0 + j - ay;
+        double u = u_x - cx*y / d, w = w_x + bx*y / d;
+        out_x[i*ny + j] = fx + u*fbx + w*fcx;
+        out_y[i*ny + j] = fy + u*fby + w*fcy;
+      }
+    }
+  }
+}
+
+static char affine_grid_doc[] =
+"affine_grid(from_points, to_points, triangles, x_min, y_min, start, output)\n\
+\n\
+from_points, to_points: shape (n, 2) arrays of corresponding points.\n\
+triangles: shape (m, 3) integer array of the indices of the vertices of\n\
+   triangles of to_points, in counterclockwise order (as from delaunay()).\n\
+x_min, y_min: the coordinates of the first pixel of the output grid.\n\
+start: first row of the output grid to calculate.\n\
+output: contiguous double array of shape (2, rows, ny) into which are\n\
+   written the x and y coordinates that the pixels of rows\n\
+   [start, start + rows) of the output grid map to.\n\
+\n\
+Output grid pixel (i, j) lies at (x_min + i, y_min + j), and is mapped by\n\
+the affine map that takes the triangle of to_points containing it to the\n\
+corresponding triangle of from_points. Pixels in no triangle are mapped to\n\
+(-1, -1). The global interpreter lock is released during the calculation.";
+
+static PyObject*
+affine_grid(PyObject *self, PyObject *args)
+{
+  PyObject* from_array = NULL;
+  PyObject* to_array = NULL;
+  PyObject* triangles_array = NULL;
+  PyArrayObject* output_array;
+  double x_min, y_min;
+  int start, n, n_triangles, rows, ny;
+  int* triangles;
+
+  if (!PyArg_ParseTuple(args, "OOOddiO!:affine_grid", &from_array, &to_array,
+    &triangles_array, &x_min, &y_min, &start, &PyArray_Type, &output_array))
+    return NULL;
+
+  from_array = PyArray_FromAny(from_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  to_array = PyArray_FromAny(to_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  triangles_array = PyArray_FromAny(triangles_array, PyArray_DescrFromType(NPY_INT),
+    2, 2, NPY_CARRAY, NULL);
+  if (!from_array || !to_array || !triangles_array) goto fail;
+  n = PyArray_DIM(to_array, 0);
+  if (PyArray_DIM(to_array, 1) != 2 || PyArray_DIM(from_array, 0) != n ||
+      PyArray_DIM(from_array, 1) != 2) {
+    PyErr_SetString(PyExc_ValueError, "from_points and to_points must both be shape (n, 2).");
+    goto fail;
+  }
+  n_triangles = PyArray_DIM(triangles_array, 0);
+  triangles = (int *) PyArray_DATA(triangles_array);
+  if (PyArray_DIM(triangles_array, 1) != 3) {
+    PyErr_SetString(PyExc_ValueError, "triangles must be shape (m, 3).");
+    goto fail;
+  }
+  for (int i = 0; i < 3*n_triangles; i++) {
+    if (triangles[i] < 0 || triangles[i] >= n) {
+      PyErr_SetString(PyExc_ValueError, "Triangle vertex indices must be valid point indices.");
+      goto fail;
+    }
+  }
+  if (PyArray_TYPE(output_array) != NPY_DOUBLE || !PyArray_ISCARRAY(output_array) ||
+      PyArray_NDIM(output_array) != 3 || PyArray_DIM(output_array, 0) != 2) {
+    PyErr_SetString(PyExc_ValueError, "output must be a contiguous double array of shape (2, rows, ny).");
+    goto fail;
+  }
+  rows = PyArray_DIM(output_array, 1);
+  ny = PyArray_DIM(output_array, 2);
+
+  Py_BEGIN_ALLOW_THREADS
+  affine_grid((double *) PyArray_DATA(from_array), (double *) PyArray_DATA(to_array),
+    triangles, n_triangles, x_min, y_min, start, rows, ny,
+    (double *) PyArray_DATA(output_array));
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(triangles_array);
+  Py_DECREF(to_array);
+  Py_DECREF(from_array);
+  Py_RETURN_NONE;
+
+  fail:
+  Py_XDECREF(triangles_array);
+  Py_XDECREF(to_array);
+  Py_XDECREF(from_array);
+  return NULL;
+}
+
+static PyMethodDef _image_warp_methods[] = {
+  {"tps_grid", tps_grid, METH_VARARGS, tps_grid_doc},
+  {"kernel_sums", kernel_sums, METH_VARARGS, kernel_sums_doc},
+  {"nearest_neighbors", nearest_neighbors, METH_VARARGS, nearest_neighbors_doc},
+  {"bilinear_grid", bilinear_grid, METH_VARARGS, bilinear_grid_doc},
+  {"delaunay", delaunay, METH_VARARGS, delaunay_doc},
+  {"affine_grid", affine_grid, METH_VARARGS, affine_grid_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC
+init_image_warp(void)
+{
+  Py_InitModule3("_image_warp", _image_warp_methods, _image_warp_doc);
+  import_array();
+}
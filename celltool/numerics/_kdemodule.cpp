@@ -0,0 +1,144 @@
+// Copyright 2007 Zachary Pincus
+// This file is part of CellTool.
+//
+// CellTool is free software; you can redistribute it and/or modify
+// it under the terms of version 2 of the GNU General Public License as
+// published by the Free Software Foundation.
+
+#include <Python.h>
+#include "numpy/arrayobject.h"
+// kd-tree from Sean Mauch's computational geometry package
+#include "geom/orq/KDTree.h"
+#include <vector>
+#include <iterator>
+#include <cmath>
+
+static char _kde_doc[] =
+"This module provides kd-tree accelerated evaluation of Gaussian kernel\n\
+density estimates.";
+
+// Sum exp(-|x - p|^2 / 2) over the data points x within 'cutoff' of each
+// query point p. The kd-tree returns the data points within the box of
+// half-width 'cutoff' around each query point; those outside the cutoff
+// sphere are then discarded.
+template<int N>
+static void gaussian_sums(const double* data, int n, const double* points, int m,
+  double cutoff, double* sums) {
+  typedef ads::FixedArray<N, double> Point;
+  typedef typename std::vector<Point>::const_iterator Record;
+  typedef std::back_insert_iterator<std::vector<Record> > Output;
+  typedef geom::KDTree<N, Record, Point, double, ads::Dereference<Record>, Output> Tree;
+
+  std::vector<Point> data_points(n);
+  for (int i = 0; i < n; i++) {
+    for (int d = 0; d < N; d++) data_points[i][d] = data[i*N + d];
+  }
+  Tree tree(data_points.begin(), data_points.end());
+  std::vector<Record> found;
+  double cutoff_sq = cutoff * cutoff;
+  Point low, high;
+  for (int j = 0; j < m; j++) {
+    const double* p = points + j*N;
+    for (int d = 0; d < N; d++) {
+      low[d] = p[d] - cutoff;
+      high[d] = p[d] + cutoff;
+    }
+    found.clear();
+    tree.computeWindowQuery(std::back_inserter(found), typename Tree::BBox(low, high));
+    double sum = 0;
+    for (typename std::vector<Record>::const_iterator i = found.begin(); i != found.end(); ++i) {
+      double dist_sq = 0;
+      for (int d = 0; d < N; d++) {
+        double diff = (**i)[d] - p[d];
+        dist_sq += diff * diff;
+      }
+      if (dist_sq < cutoff_sq) sum += std::exp(-dist_sq / 2);
+    }
+    sums[j] = sum;
+  }
+}
+
+static char gaussian_sums_doc[] =
+"gaussian_sums(data, points, cutoff) -> sums\n\
+\n\
+data: shape (n, d) array of n data points, in coordinates where the kernel\n\
+   covariance is the identity (i.e. whitened by the kernel covariance).\n\
+points: shape (m, d) array of m query points, in the same coordinates.\n\
+cutoff: data points farther than this from a query point are ignored.\n\
+\n\
+Returns the shape (m,) array of sums of exp(-|x - p|^2 / 2) over the data\n\
+points x within the cutoff distance of each query point p. Only d = 1, 2, or\n\
+3 is supported. The global interpreter lock is released during the\n\
+calculation.";
+
+static PyObject*
+gaussian_sums(PyObject *self, PyObject *args)
+{
+  PyObject* data_array = NULL;
+  PyObject* points_array = NULL;
+  PyObject* sums_array = NULL;
+  double cutoff;
+  int n, m, d;
+  npy_intp sums_dims[1];
+  double *data, *points, *sums;
+
+  if (!PyArg_ParseTuple(args, "OOd:gaussian_sums", &data_array, &points_array, &cutoff))
+    return NULL;
+
+  data_array = PyArray_FromAny(data_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  points_array = PyArray_FromAny(points_array, PyArray_DescrFromType(NPY_DOUBLE),
+    2, 2, NPY_CARRAY, NULL);
+  if (!data_array || !points_array) goto fail;
+  n = PyArray_DIM(data_array, 0);
+  m = PyArray_DIM(points_array, 0);
+  d = PyArray_DIM(data_array, 1);
+  if (PyArray_DIM(points_array, 1) != d) {
+    PyErr_SetString(PyExc_ValueError, "data and points must have the same dimension.");
+    goto fail;
+  }
+  if (d < 1 || d > 3) {
+    PyErr_SetString(PyExc_ValueError, "Only 1, 2, or 3-dimensional data are supported.");
+    goto fail;
+  }
+  sums_dims[0] = m;
+  sums_array = PyArray_SimpleNew(1, sums_dims, NPY_DOUBLE);
+  if (!sums_array) goto fail;
+  data = (double *) PyArray_DATA(data_array);
+  points = (double *) PyArray_DATA(points_array);
+  sums = (double *) PyArray_DATA(sums_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  if (n == 0) {
+    for (int j = 0; j < m; j++) sums[j] = 0;
+  } else if (d == 1) {
+    gaussian_sums<1>(data, n, points, m, cutoff, sums);
+  } else if (d == 2) {
+    gaussian_sums<2>(data, n, points, m, cutoff, sums);
+  } else {
+    gaussian_sums<3>(data, n, points, m, cutoff, sums);
+  }
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(points_array);
+  Py_DECREF(data_array);
+  return sums_array;
+
+  fail:
+  Py_XDECREF(sums_array);
+  Py_XDECREF(points_array);
+  Py_XDECREF(data_array);
+  return NULL;
+}
+
+static PyMethodDef _kde_methods[] = {
+  {"gaussian_sums", gaussian_sums, METH_VARARGS, gaussian_sums_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC
+init_kde(void)
+{
+  Py_InitModule3("_kde", _kde_methods, _kde_doc);
+  import_array();
+}
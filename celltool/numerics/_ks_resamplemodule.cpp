@@ -0,0 +1,176 @@
+// Copyright 2011 Zachary Pincus
+// This file is part of CellTool.
+//
+// CellTool is free software; you can redistribute it and/or modify
+// it under the terms of version 2 of the GNU General Public License as
+// published by the Free Software Foundation.
+
+#include <Python.h>
+#include "numpy/arrayobject.h"
+// Mersenne twister from Sean Mauch's numerical package
+#include "numerical/random/uniform/DiscreteUniformGeneratorMt19937.h"
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+static char _ks_resample_doc[] =
+"This module provides a fast bootstrap of the two-sample Kolmogorov-Smirnov\n\
+statistic.";
+
+// Bootstrap resampler for the KS distance between two sorted datasets.
+// Rather than materializing and sorting each resampling, a resampling is
+// represented as the number of times each (already sorted) data point was
+// drawn. The empirical CDFs of the two resamplings can then be compared in a
+// single pass over the merged order of the two datasets.
+class KSBootstrap {
+  public:
+  KSBootstrap(const double* data1, int n1, int sample1,
+    const double* data2, int n2, int sample2)
+    : _sample1(sample1), _sample2(sample2), _counts1(n1), _counts2(n2) {
+    // Merge the two sorted datasets, recording for each merged element
+    // which dataset it came from and its index therein. An element ends a
+    // group if the next element has a different value: the CDFs are only
+    // compared at group ends, so that tied values are handled as ks_stat()
+    // does (cdf(x) counts all values <= x).
+    int n = n1 + n2;
+    _from_first.resize(n);
+    _index.resize(n);
+    _group_end.resize(n);
+    std::vector<double> values(n);
+    int i = 0, j = 0, k = 0;
+    while (i < n1 || j < n2) {
+      if (j == n2 || (i < n1 && data1[i] <= data2[j])) {
+        values[k] = data1[i];
+        _from_first[k] = true;
+        _index[k] = i++;
+      } else {
+        values[k] = data2[j];
+        _from_first[k] = false;
+        _index[k] = j++;
+      }
+      k++;
+    }
+    for (k = 0; k < n; k++) {
+      _group_end[k] = (k == n - 1 || values[k + 1] != values[k]);
+    }
+  }
+
+  // Draw one pair of resamplings and return the KS distance between them.
+  template<class Generator>
+  double resample(Generator& random) {
+    draw(random, _counts1, _sample1);
+    draw(random, _counts2, _sample2);
+    // Compare the CDFs scaled by sample1 * sample2, so that the running
+    // values are exact integers.
+    long long cdf1 = 0, cdf2 = 0, max_difference = 0;
+    int n = _index.size();
+    for (int k = 0; k < n; k++) {
+      if (_from_first[k]) cdf1 += _counts1[_index[k]];
+      else cdf2 += _counts2[_index[k]];
+      if (_group_end[k]) {
+        long long difference = std::llabs(cdf1 * _sample2 - cdf2 * _sample1);
+        if (difference > max_difference) max_difference = difference;
+      }
+    }
+    return double(max_difference) / (double(_sample1) * double(_sample2));
+  }
+
+  private:
+  template<class Generator>
+  static void draw(Generator& random, std::vector<int>& counts, int samples) {
+    std::fill(counts.begin(), counts.end(), 0);
+    unsigned long long n = counts.size();
+    for (int i = 0; i < samples; i++) {
+      // Scale the 32-bit deviate to [0, n) by multiplication rather than
+      // modulus, which would favor the low indices.
+      counts[(unsigned long long) random() * n >> 32]++;
+    }
+  }
+
+  int _sample1, _sample2;
+  std::vector<int> _counts1, _counts2;
+  std::vector<bool> _from_first, _group_end;
+  std::vector<int> _index;
+};
+
+static char bootstrap_ks_doc[] =
+"bootstrap_ks(data1, sample1, data2, sample2, count, seed) -> stats\n\
+\n\
+data1, data2: sorted 1D arrays of data values.\n\
+sample1, sample2: number of values to draw (with replacement) from data1 and\n\
+   data2 in each resampling.\n\
+count: number of pairs of resamplings to draw.\n\
+seed: seed for the Mersenne twister random number generator. The output is\n\
+   completely determined by the data and the seed.\n\
+\n\
+Returns the shape (count,) array of KS distances between each pair of\n\
+resamplings (in the order drawn, not sorted). The global interpreter lock is\n\
+released during the calculation.";
+
+static PyObject*
+bootstrap_ks(PyObject *self, PyObject *args)
+{
+  PyObject* data1_array = NULL;
+  PyObject* data2_array = NULL;
+  PyObject* stats_array = NULL;
+  int sample1, sample2, count, n1, n2;
+  unsigned long seed;
+  npy_intp stats_dims[1];
+  double *data1, *data2, *stats;
+
+  if (!PyArg_ParseTuple(args, "OiOiik:bootstrap_ks", &data1_array, &sample1,
+    &data2_array, &sample2, &count, &seed))
+    return NULL;
+
+  data1_array = PyArray_FromAny(data1_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  data2_array = PyArray_FromAny(data2_array, PyArray_DescrFromType(NPY_DOUBLE),
+    1, 1, NPY_CARRAY, NULL);
+  if (!data1_array || !data2_array) goto fail;
+  n1 = PyArray_DIM(data1_array, 0);
+  n2 = PyArray_DIM(data2_array, 0);
+  if (n1 == 0 || n2 == 0 || sample1 < 1 || sample2 < 1) {
+    PyErr_SetString(PyExc_ValueError, "Both datasets and both sample sizes must be non-empty.");
+    goto fail;
+  }
+  if (count < 0) {
+    PyErr_SetString(PyExc_ValueError, "The resampling count must be non-negative.");
+    goto fail;
+  }
+  stats_dims[0] = count;
+  stats_array = PyArray_SimpleNew(1, stats_dims, NPY_DOUBLE);
+  if (!stats_array) goto fail;
+  data1 = (double *) PyArray_DATA(data1_array);
+  data2 = (double *) PyArray_DATA(data2_array);
+  stats = (double *) PyArray_DATA(stats_array);
+
+  Py_BEGIN_ALLOW_THREADS
+  numerical::DiscreteUniformGeneratorMt19937 random((unsigned) seed);
+  KSBootstrap bootstrap(data1, n1, sample1, data2, n2, sample2);
+  for (int i = 0; i < count; i++) {
+    stats[i] = bootstrap.resample(random);
+  }
+  Py_END_ALLOW_THREADS
+
+  Py_DECREF(data2_array);
+  Py_DECREF(data1_array);
+  return stats_array;
+
+  fail:
+  Py_XDECREF(stats_array);
+  Py_XDECREF(data2_array);
+  Py_XDECREF(data1_array);
+  return NULL;
+}
+
+static PyMethodDef _ks_resample_methods[] = {
+  {"bootstrap_ks", bootstrap_ks, METH_VARARGS, bootstrap_ks_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC
+init_ks_resample(void)
+{
+  Py_InitModule3("_ks_resample", _ks_resample_methods, _ks_resample_doc);
+  import_array();
+}
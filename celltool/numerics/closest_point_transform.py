@@ -59,7 +59,7 @@ def _prepare_data(vertices, arcs, domain, samples):
   if arcs is None:
     # make simplest polygon from vertices.
     arc_parts = numpy.arange(vertices.shape[0])
-    arcs = numpy.array([arc_parts, numpy.roll(arc_parts, -1)], dtype = numpy.int_).transpose()
+    arcs = numpy.array([arc_parts, numpy.roll(arc_parts, -1)], dtype = numpy.intc).transpose()
   if domain is None:
     xmin, ymin = vertices.min(axis = 0)
     xmax, ymax = vertices.max(axis = 0)
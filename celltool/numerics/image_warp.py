@@ -7,16 +7,27 @@
 
 import ndimage
 import numpy
+import _image_warp
+import celltool.utility.thread_tools as thread_tools
+from celltool.utility.py23_compat import set
 
-def warp_images(from_points, to_points, images, output_region, interpolation_order = 1, approximate_grid=2):
+def warp_images(from_points, to_points, images, output_region, interpolation_order = 1, approximate_grid=2, threads=None, tolerance=None, warp_type='thin-plate'):
   """Define a thin-plate-spline warping transform that warps from the from_points
   to the to_points, and then warp the given images by that transform. This
   transform is described in the paper: "Principal Warps: Thin-Plate Splines and
   the Decomposition of Deformations" by F.L. Bookstein.
   
+  Alternately, a piecewise-affine transform can be used, which triangulates the
+  to_points and maps each triangle affinely onto the corresponding triangle of
+  from_points. This is less smooth than a thin-plate spline, but the time
+  taken does not depend on the number of landmarks. Only the region within the
+  convex hull of the to_points is defined by such a transform; output pixels
+  outside of it are zero.
+  
   Parameters:
     - from_points and to_points: Nx2 arrays containing N 2D landmark points.
-    - images: list of images to warp with the given warp transform.
+    - images: list of images to warp with the given warp transform. Images
+        with several channels along a third axis are warped channel by channel.
     - output_region: the (xmin, ymin, xmax, ymax) region of the output
         image that should be produced. (Note: The region is inclusive, i.e. 
         xmin <= x <= xmax)
@@ -27,44 +38,108 @@ def warp_images(from_points, to_points, images, output_region, interpolation_ord
         times smaller than the output image region, and then the transform is
         bilinearly interpolated to the larger region. This is fairly accurate
         for values up to 10 or so.
+    - threads: number of threads to use to evaluate the transform; if None,
+        one per processor.
+    - tolerance: if not None, the transform is both solved for and evaluated
+        with a fast multipole approximation, to approximately this relative
+        accuracy. This is far faster than the exact calculation for more
+        than a few hundred landmarks (e.g. all the points of dense contours):
+        the time taken grows only linearly with the number of landmarks and
+        output pixels. A tolerance of 1e-4 is ample for most purposes.
+    - warp_type: 'thin-plate' or 'piecewise-affine'. The approximate_grid and
+        tolerance parameters apply only to thin-plate-spline warps.
   """
-  transform = _make_inverse_warp(from_points, to_points, output_region, approximate_grid)
-  return [ndimage.map_coordinates(numpy.asarray(image), transform, order=interpolation_order) for image in images]
+  if warp_type == 'thin-plate':
+    shape, transform_rows = _make_inverse_warp(from_points, to_points, output_region, approximate_grid, threads, tolerance)
+  elif warp_type == 'piecewise-affine':
+    shape, transform_rows = _make_inverse_affine_warp(from_points, to_points, output_region)
+  else:
+    raise ValueError("Warp type '%s' is invalid. Must be 'thin-plate' or 'piecewise-affine'."%warp_type)
+  return _warp_rows(images, shape, transform_rows, interpolation_order, threads)
 
-def _make_inverse_warp(from_points, to_points, output_region, approximate_grid):
+def _make_inverse_warp(from_points, to_points, output_region, approximate_grid, threads = None, tolerance = None):
+  """Return the shape of the output region, and a function transform_rows(start, stop)
+  that returns the (2, stop-start, shape[1]) array of the input-image coordinates
+  for the given rows of the output."""
   x_min, y_min, x_max, y_max = output_region
   if approximate_grid is None: approximate_grid = 1
   x_steps = (x_max - x_min) / approximate_grid
   y_steps = (y_max - y_min) / approximate_grid
-  x, y = numpy.mgrid[x_min:x_max:x_steps*1j, y_min:y_max:y_steps*1j]
+  x = numpy.linspace(x_min, x_max, int(x_steps))
+  y = numpy.linspace(y_min, y_max, int(y_steps))
 
   # make the reverse transform warping from the to_points to the from_points, because we
   # do image interpolation in this reverse fashion
-  transform = _make_warp(to_points, from_points, x, y)
+  to_points = numpy.asarray(to_points, dtype=float)
+  coeffs = _make_warp(to_points, from_points, tolerance)
   
-  if approximate_grid != 1:
+  if approximate_grid == 1:
+    shape = (len(x), len(y))
+    if tolerance is None:
+      order = 0
+    else:
+      order = _multipole_order(tolerance)
+    def transform_rows(start, stop):
+      transform = numpy.empty((2, stop - start, shape[1]))
+      _image_warp.tps_grid(to_points, coeffs, x[start:stop], y, transform, 0, stop - start, order, _theta)
+      return transform
+  else:
     # linearly interpolate the zoomed transform grid
-    new_x, new_y = numpy.mgrid[x_min:x_max+1, y_min:y_max+1]
-    x_fracs, x_indices = numpy.modf((x_steps-1)*(new_x-x_min)/float(x_max-x_min))
-    y_fracs, y_indices = numpy.modf((y_steps-1)*(new_y-y_min)/float(y_max-y_min))
-    x_indices = x_indices.astype(int)
-    y_indices = y_indices.astype(int)
-    x1 = 1 - x_fracs
-    y1 = 1 - y_fracs
-    ix1 = (x_indices+1).clip(0, x_steps-1)
-    iy1 = (y_indices+1).clip(0, y_steps-1)
-    t00 = transform[0][(x_indices, y_indices)]
-    t01 = transform[0][(x_indices, iy1)]
-    t10 = transform[0][(ix1, y_indices)]
-    t11 = transform[0][(ix1, iy1)]
-    transform_x = t00*x1*y1 + t01*x1*y_fracs + t10*x_fracs*y1 + t11*x_fracs*y_fracs
-    t00 = transform[1][(x_indices, y_indices)]
-    t01 = transform[1][(x_indices, iy1)]
-    t10 = transform[1][(ix1, y_indices)]
-    t11 = transform[1][(ix1, iy1)]
-    transform_y = t00*x1*y1 + t01*x1*y_fracs + t10*x_fracs*y1 + t11*x_fracs*y_fracs
-    transform = [transform_x, transform_y]
-  return transform  
+    grid = _calculate_f(coeffs, to_points, x, y, threads, tolerance)
+    shape = (x_max - x_min + 1, y_max - y_min + 1)
+    def transform_rows(start, stop):
+      transform = numpy.empty((2, stop - start, shape[1]))
+      _image_warp.bilinear_grid(grid, x_max - x_min, y_max - y_min, start, transform)
+      return transform
+  return shape, transform_rows
+
+def _make_inverse_affine_warp(from_points, to_points, output_region):
+  """Return the shape of the output region, and a function transform_rows(start, stop)
+  as above, for the piecewise-affine warp defined by the Delaunay triangulation
+  of the to_points. Output pixels outside of the triangulation are mapped to
+  (-1, -1), and so take the constant value of the interpolation boundary."""
+  x_min, y_min, x_max, y_max = output_region
+  from_points = numpy.asarray(from_points, dtype=float)
+  to_points = numpy.asarray(to_points, dtype=float)
+  triangles = _image_warp.delaunay(to_points)
+  shape = (x_max - x_min + 1, y_max - y_min + 1)
+  def transform_rows(start, stop):
+    transform = numpy.empty((2, stop - start, shape[1]))
+    _image_warp.affine_grid(from_points, to_points, triangles, x_min, y_min, start, transform)
+    return transform
+  return shape, transform_rows
+
+# Number of output pixels warped at a time by each thread.
+_block_pixels = 65536
+
+def _warp_rows(images, shape, transform_rows, order, threads):
+  """Warp the images (and each channel of images with a third axis) to arrays of
+  the given shape, a block of rows at a time, so that the input coordinates
+  of only a few blocks of the output are in memory at once. The blocks are
+  divided among several threads."""
+  channels = []
+  outputs = []
+  for image in images:
+    image = numpy.asarray(image)
+    output = numpy.empty(shape + image.shape[2:], dtype=image.dtype)
+    outputs.append(output)
+    if image.ndim == 2:
+      channels.append((image, output))
+    else:
+      for c in range(image.shape[2]):
+        channels.append((image[:,:,c], output[:,:,c]))
+  if order > 1:
+    channels = [(ndimage.spline_filter(channel, order, output=ndimage._ni_support._prefilter_type(output)), output)
+      for channel, output in channels]
+  rows = max(1, _block_pixels // max(1, shape[1]))
+  def warp_block(start):
+    stop = min(start + rows, shape[0])
+    transform = transform_rows(start, stop)
+    for channel, output in channels:
+      output[start:stop] = ndimage.map_coordinates(channel, transform,
+        output=output.dtype, order=order, prefilter=False, threads=1)
+  thread_tools.thread_map(warp_block, range(0, shape[0], rows), threads)
+  return outputs
 
 _small = 1e-100
 def _U(x):
@@ -84,25 +159,170 @@ def _make_L_matrix(points):
   L = numpy.asarray(numpy.bmat([[K, P],[P.transpose(), O]]))
   return L
 
-def _calculate_f(coeffs, points, x, y):
-  w = coeffs[:-3]
-  a1, ax, ay = coeffs[-3:]
-  # The following uses too much RAM:
-  # distances = _U(numpy.sqrt((points[:,0]-x[...,numpy.newaxis])**2 + (points[:,1]-y[...,numpy.newaxis])**2))
-  # summation = (w * distances).sum(axis=-1)
-  summation = numpy.zeros(x.shape)
-  for wi, Pi in zip(w, points):
-   summation += wi * _U(numpy.sqrt((x-Pi[0])**2 + (y-Pi[1])**2))
-  return a1 + ax*x + ay*y + summation
-
-def _make_warp(from_points, to_points, x_vals, y_vals):
+# Boxes of landmarks and pixels are treated with the fast multipole
+# approximation when the sum of their radii is less than _theta times their
+# distance. For this value, the error of the approximation relative to the
+# size of the kernel sums is about 10**-order, where order is the number of
+# interpolation nodes along each side of a box. The kernel sums are often
+# larger than the warped coordinates by a factor of 100 or so (they partly
+# cancel one another), so two more orders are used than the tolerance alone
+# would suggest.
+_theta = 0.6
+def _multipole_order(tolerance):
+  return max(2, int(numpy.ceil(-numpy.log10(tolerance))) + 2)
+
+def _calculate_f(coeffs, points, x, y, threads = None, tolerance = None):
+  """Evaluate the x and y coordinates of the warp defined by the (n+3, 2)
+  coefficient array at each grid point (x[i], y[j]). Returns an array of shape
+  (2, len(x), len(y)); the rows of the grid are divided among several
+  threads. If tolerance is not None, the sum over the landmarks is calculated
+  with a fast multipole approximation."""
+  output = numpy.empty((2, len(x), len(y)))
+  points = numpy.asarray(points, dtype=float)
+  if tolerance is None:
+    order = 0
+  else:
+    order = _multipole_order(tolerance)
+  def evaluate_rows(rows):
+    start, stop = rows
+    _image_warp.tps_grid(points, coeffs, x, y, output, start, stop, order, _theta)
+  threads = thread_tools.thread_count(threads)
+  thread_tools.thread_map(evaluate_rows, thread_tools.partition(len(x), threads), threads)
+  return output
+
+# Parameters of the approximate cardinal function preconditioner: the number of
+# nearest neighbors and of points spread across the landmarks used for each
+# landmark's cardinal function.
+_cardinal_neighbors = 30
+_cardinal_spread_points = 16
+
+def _solve_tps(points, values, tolerance, max_iterations = 100):
+  """Find the (n+3, 2) thin-plate-spline coefficients that map the n points to
+  the given values, to within the given relative tolerance.
+  
+  The landmark weights w and affine coefficients a must satisfy K w + P a = v
+  and P^T w = 0, where K is the matrix of kernel values between the points and
+  P the matrix with rows [1, x, y]. This system is badly conditioned for
+  closely-spaced landmarks, so it is preconditioned with approximate cardinal
+  functions as described in "Fast fitting of radial basis functions: Methods
+  based on preconditioned GMRES iteration" by R.K. Beatson, J.B. Cherrie and
+  C.T. Mouat: for each landmark i, the weights c_i of a thin-plate spline
+  that is one at that landmark and zero at a few nearby and far-away ones are
+  found. Then w = C^T m, where the rows of C are the c_i, satisfies P^T w = 0,
+  and K C^T is close to the identity (up to an affine term) so that
+  Q K C^T m = Q v, where Q projects out the affine part, is rapidly solved
+  by the GMRES method. Products with K are calculated with the fast
+  multipole approximation, so each iteration takes time linear in n.
+  """
+  points = numpy.asarray(points, dtype=float)
+  values = numpy.asarray(values, dtype=float)
+  n = len(points)
+  P = numpy.ones((n, 3))
+  P[:,1:] = points
+  if n <= 3 * (_cardinal_neighbors + _cardinal_spread_points):
+    # small problems are faster to solve directly
+    L = _make_L_matrix(points)
+    V = numpy.zeros((n+3, 2))
+    V[:n] = values
+    return numpy.dot(numpy.linalg.pinv(L), V)
+  order = _multipole_order(tolerance)
+  indices, cardinal_weights = _cardinal_functions(points)
+  P_basis = numpy.linalg.qr(P)[0]
+  def project(v):
+    return v - numpy.dot(P_basis, numpy.dot(P_basis.transpose(), v))
+  def K(w):
+    return _image_warp.kernel_sums(points, w, points, order, _theta)
+  def C_transpose(m):
+    w = numpy.empty(m.shape)
+    for c in range(m.shape[1]):
+      w[:,c] = numpy.bincount(indices.ravel(), (cardinal_weights * m[:,c,numpy.newaxis]).ravel())
+    return w
+  m = _gmres(lambda m: project(K(C_transpose(m))), project(values), tolerance, max_iterations)
+  w = C_transpose(m)
+  # the affine part fits the remainder of the values
+  a = numpy.linalg.lstsq(P, values - K(w))[0]
+  return numpy.concatenate([w, a])
+
+def _cardinal_functions(points):
+  """Return (indices, weights) arrays of shape (n, k), where the thin-plate
+  spline with the given weights on the given points is (with an affine term)
+  one at point i and zero at the other points in indices[i]."""
+  n = len(points)
+  # choose points spread over the set by repeatedly taking the point farthest
+  # from those already chosen
+  spread = [numpy.argmax(((points - points.mean(axis=0))**2).sum(axis=1))]
+  distances = ((points - points[spread[0]])**2).sum(axis=1)
+  for i in range(_cardinal_spread_points - 1):
+    spread.append(numpy.argmax(distances))
+    distances = numpy.minimum(distances, ((points - points[spread[-1]])**2).sum(axis=1))
+  spread_set = set(spread)
+  k = _cardinal_neighbors + _cardinal_spread_points
+  neighbors = _image_warp.nearest_neighbors(points, min(n, k + _cardinal_spread_points + 1))
+  indices = numpy.empty((n, k), dtype=int)
+  weights = numpy.empty((n, k))
+  A = numpy.zeros((k+3, k+3))
+  A[:k, k] = A[k, :k] = 1
+  rhs = numpy.zeros(k+3)
+  rhs[0] = 1
+  for i in range(n):
+    local = [i] + [j for j in spread if j != i]
+    local += [j for j in neighbors[i] if j != i and j not in spread_set][:k - len(local)]
+    local_points = points[local]
+    A[:k, :k] = _U(_interpoint_distances(local_points))
+    A[:k, k+1:] = local_points
+    A[k+1:, :k] = local_points.transpose()
+    try:
+      solution = numpy.linalg.solve(A, rhs)
+    except numpy.linalg.LinAlgError:
+      solution = numpy.linalg.lstsq(A, rhs)[0]
+    indices[i] = local
+    weights[i] = solution[:k]
+  return indices, weights
+
+def _gmres(operator, b, tolerance, max_iterations):
+  """Solve operator(x) = b with the GMRES method (without restarts) for each
+  column of the (n, c) array b, to the given tolerance relative to the norm of
+  b. The columns are solved for together so that each call to the operator
+  acts on all c columns at once."""
+  n, columns = b.shape
+  beta = numpy.sqrt((b**2).sum(axis=0))
+  basis = [b / numpy.where(beta == 0, 1, beta)]
+  H = numpy.zeros((max_iterations+1, max_iterations, columns))
+  for k in range(max_iterations):
+    # Arnoldi step, with modified Gram-Schmidt orthogonalization
+    v = operator(basis[k])
+    for j in range(k+1):
+      H[j,k] = (basis[j] * v).sum(axis=0)
+      v = v - H[j,k] * basis[j]
+    H[k+1,k] = numpy.sqrt((v**2).sum(axis=0))
+    basis.append(v / numpy.where(H[k+1,k] == 0, 1, H[k+1,k]))
+    solutions = []
+    converged = True
+    for c in range(columns):
+      e = numpy.zeros(k+2)
+      e[0] = beta[c]
+      y = numpy.linalg.lstsq(H[:k+2,:k+1,c], e)[0]
+      residual = numpy.sqrt(((numpy.dot(H[:k+2,:k+1,c], y) - e)**2).sum())
+      if residual > tolerance * beta[c] and H[k+1,k,c] != 0:
+        converged = False
+      solutions.append(y)
+    if converged:
+      break
+  x = numpy.empty((n, columns))
+  for c in range(columns):
+    x[:,c] = numpy.dot(numpy.array([v[:,c] for v in basis[:k+1]]).transpose(), solutions[c])
+  return x
+
+def _make_warp(from_points, to_points, tolerance = None):
+  """Return the (n+3, 2) thin-plate-spline coefficients of the warp from the
+  from_points to the to_points."""
   from_points, to_points = numpy.asarray(from_points), numpy.asarray(to_points)
+  if tolerance is not None:
+    return _solve_tps(from_points, to_points, tolerance)
   err = numpy.seterr(divide='ignore')
   L = _make_L_matrix(from_points)
   V = numpy.resize(to_points, (len(to_points)+3, 2))
   V[-3:, :] = 0
   coeffs = numpy.dot(numpy.linalg.pinv(L), V)
-  x_warp = _calculate_f(coeffs[:,0], from_points, x_vals, y_vals)
-  y_warp = _calculate_f(coeffs[:,1], from_points, x_vals, y_vals)
   numpy.seterr(**err)
-  return [x_warp, y_warp]
+  return coeffs
@@ -22,6 +22,7 @@ from numpy import linalg
 from numpy import atleast_2d, reshape, zeros, newaxis, dot, exp, pi, sqrt, \
      ravel, power, atleast_1d, squeeze, sum, transpose, cov
 from numpy.random import randint, multivariate_normal
+import numpy
 
 __all__ = ['gaussian_kde',
 ]
@@ -46,6 +47,11 @@ class gaussian_kde(object):
     -------
     kde.evaluate(points) : array
         evaluate the estimated pdf on a provided set of points
+    kde.evaluate_tree(points, tolerance) : array, float
+        evaluate the pdf, ignoring negligible kernels, using a kd-tree
+    kde.evaluate_grid(low, high, samples, tolerance) : list, array, float
+        approximately evaluate the pdf on a regular 1D or 2D grid by binning
+        the data and convolving with the kernel via the FFT
     kde(points) : array
         same as kde.evaluate(points)
     kde.integrate_gaussian(mean, cov) : float
@@ -94,18 +100,8 @@ class gaussian_kde(object):
         the dimensionality of the KDE.
         """
 
-        points = atleast_2d(points).astype(self.dataset.dtype)
-
+        points = self._check_points(points)
         d, m = points.shape
-        if d != self.d:
-            if d == 1 and m == self.d:
-                # points was passed in as a row vector
-                points = reshape(points, (self.d, 1))
-                m = 1
-            else:
-                msg = "points have dimension %s, dataset has dimension %s" % (d,
-                    self.d)
-                raise ValueError(msg)
 
         result = zeros((m,), points.dtype)
 
@@ -131,6 +127,138 @@ class gaussian_kde(object):
 
     __call__ = evaluate
 
+    def _check_points(self, points):
+        points = atleast_2d(points).astype(self.dataset.dtype)
+
+        d, m = points.shape
+        if d != self.d:
+            if d == 1 and m == self.d:
+                # points was passed in as a row vector
+                points = reshape(points, (self.d, 1))
+            else:
+                msg = "points have dimension %s, dataset has dimension %s" % (d,
+                    self.d)
+                raise ValueError(msg)
+        return points
+
+    def _whitening_transform(self):
+        # inv_cov = L L', so x' inv_cov x = |L'x|^2: in the coordinates L'x,
+        # the kernel covariance is the identity.
+        return linalg.cholesky(self.inv_cov)
+
+    def evaluate_tree(self, points, tolerance=1e-8):
+        """Evaluate the estimated pdf on a set of points, ignoring kernels
+        whose contribution is less than 'tolerance' times their peak value.
+
+        A kd-tree (in the _kde extension module) finds the data points near
+        each point, so this is much faster than evaluate() for large data
+        sets. Only 1, 2, and 3-dimensional data are supported.
+
+        Parameters
+        ----------
+        points : (# of dimensions, # of points)-array
+            As for evaluate().
+        tolerance : float
+            Relative size of the smallest kernel contribution to include.
+
+        Returns
+        -------
+        values : (# of points,)-array
+            The values at each point.
+        error_bound : float
+            The maximum absolute difference between the values and those
+            that evaluate() would return.
+        """
+        import _kde
+        points = self._check_points(points)
+        whiten = self._whitening_transform()
+        data = dot(transpose(self.dataset), whiten)
+        points = dot(transpose(points), whiten)
+        cutoff = sqrt(-2 * numpy.log(tolerance))
+        sums = _kde.gaussian_sums(data, points, cutoff)
+        return sums / self._norm_factor, tolerance * self.n / self._norm_factor
+
+    def evaluate_grid(self, low, high, samples, tolerance=1e-8):
+        """Approximately evaluate the estimated pdf on a regular 1D or 2D grid.
+
+        The data are linearly binned onto the grid (extended by the kernel
+        cutoff radius on each side), and the bin counts are convolved with
+        the kernel, sampled on the grid and truncated where its value falls
+        below 'tolerance' times its peak, via the FFT. This takes
+        O(n + g log g) time for n data points and g grid points.
+
+        Parameters
+        ----------
+        low, high : (# of dimensions,)-arrays (or scalars for 1D data)
+            The coordinates of the first and last grid points.
+        samples : int or (# of dimensions,)-sequence of ints
+            The number of grid points along each dimension.
+        tolerance : float
+            Relative size of the smallest kernel contribution to include.
+
+        Returns
+        -------
+        grid : list of (samples[i],)-arrays
+            The grid coordinates along each dimension.
+        values : samples-shaped array
+            The values at each grid point.
+        error_bound : float
+            An upper bound on the absolute difference between the values and
+            those that evaluate() would return. This is the sum of the
+            truncation error and the linear binning error, which is at most
+            sum(delta[i]**2 * inv_cov[i,i]) / 8 times the kernel peak, for
+            grid spacings delta[i].
+        """
+        if self.d > 2:
+            raise ValueError('Only 1D and 2D grids are supported.')
+        low = atleast_1d(low).astype(float)
+        high = atleast_1d(high).astype(float)
+        samples = atleast_1d(samples).astype(int)
+        if samples.shape == (1,):
+            samples = samples.repeat(self.d)
+        if low.shape != (self.d,) or high.shape != (self.d,) or samples.shape != (self.d,):
+            raise ValueError('Grid bounds and samples must have dimension %s' % self.d)
+        if (samples < 2).any():
+            raise ValueError('Grids must have at least 2 samples in each dimension.')
+        delta = (high - low) / (samples - 1)
+        cutoff = sqrt(-2 * numpy.log(tolerance))
+        # the kernel is truncated to the ellipse where its energy is below
+        # cutoff**2/2; along dimension i that extends cutoff*sqrt(cov[i,i]).
+        pad = numpy.ceil(cutoff * sqrt(numpy.diag(self.covariance)) / delta).astype(int)
+        extended_low = low - pad * delta
+        extended = samples + 2 * pad
+        # linear binning: each data point is split between the grid points
+        # surrounding it, in proportion to its proximity to each.
+        position = (transpose(self.dataset) - extended_low) / delta
+        inside = numpy.logical_and.reduce(((position >= 0) & (position <= extended - 1)), axis=1)
+        position = position[inside]
+        index = numpy.minimum(numpy.floor(position).astype(int), extended - 2)
+        fraction = position - index
+        counts = zeros(numpy.product(extended), float)
+        strides = numpy.cumprod(numpy.concatenate([extended[1:], [1]])[::-1])[::-1]
+        for corner in numpy.ndindex(*((2,) * self.d)):
+            corner = numpy.array(corner)
+            weights = numpy.where(corner, fraction, 1 - fraction).prod(axis=1)
+            flat_index = dot(index + corner, strides)
+            counts += numpy.bincount(flat_index, weights, len(counts))
+        counts = reshape(counts, extended)
+        # the kernel sampled at grid offsets from -pad to pad
+        offsets = numpy.indices(2 * pad + 1).reshape(self.d, -1).transpose() - pad
+        offsets = offsets * delta
+        energy = sum(dot(offsets, self.inv_cov) * offsets, axis=1) / 2.0
+        kernel = numpy.where(energy < cutoff**2 / 2, exp(-energy), 0)
+        kernel = reshape(kernel, 2 * pad + 1)
+        # full convolution via zero-padded FFTs; the kernel is symmetric, so
+        # grid point g of the result is at g + 2*pad in the full convolution.
+        shape = tuple(extended + 2 * pad)
+        convolved = numpy.fft.irfftn(numpy.fft.rfftn(counts, shape) * numpy.fft.rfftn(kernel, shape), shape)
+        convolved = convolved[tuple([slice(2*p, 2*p + s) for p, s in zip(pad, samples)])]
+        values = numpy.maximum(convolved, 0) / self._norm_factor
+        peak = self.n / self._norm_factor
+        error_bound = (tolerance + sum(delta**2 * numpy.diag(self.inv_cov)) / 8.0) * peak
+        grid = [numpy.linspace(l, h, s) for l, h, s in zip(low, high, samples)]
+        return grid, values, error_bound
+
     def integrate_gaussian(self, mean, cov):
         """Multiply estimated density by a multivariate Gaussian and integrate
         over the wholespace.
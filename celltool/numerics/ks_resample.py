@@ -1,4 +1,5 @@
 import numpy
+import celltool.utility.thread_tools as thread_tools
 
 def ks_stat(data1, data2):
   data1, data2 = map(numpy.asarray, (data1, data2))
@@ -14,23 +15,61 @@ def ks_stat(data1, data2):
   d = numpy.max(numpy.absolute(cdf1-cdf2))
   return d
 
-def bootstrap_ks_1_pop(pop, n):
-  l = len(pop) / 2
-  ri = numpy.random.randint
-  stats_out = [ks_stat(pop[ri(l, size=l)], pop[ri(l, size=l)]) for i in range(n)]
+def bootstrap_ks(data1, data2, n, sample_sizes = None, seed = None, threads = None, chunk_size = 1000):
+  """Return a sorted array of the KS distances between n pairs of resamplings
+  (with replacement) of data1 and data2.
+
+  Parameters:
+    - sample_sizes: (size1, size2) pair giving the number of values drawn
+        from data1 and data2 in each resampling. If None, the sizes of the
+        datasets are used.
+    - seed: integer seed for the random number generator. If None, a seed is
+        drawn from numpy.random (so numpy.random.seed() also makes the
+        resampling reproducible).
+    - threads: number of threads to use; if None, one per processor.
+    - chunk_size: the resamplings are drawn in chunks of this size, each with
+        its own random number generator seeded from 'seed'. The result
+        therefore depends on the seed but not on the number of threads.
+  """
+  import _ks_resample
+  data1 = numpy.sort(numpy.asarray(data1, dtype=float))
+  data2 = numpy.sort(numpy.asarray(data2, dtype=float))
+  if sample_sizes is None:
+    sample_sizes = len(data1), len(data2)
+  sample1, sample2 = sample_sizes
+  starts = range(0, n, chunk_size)
+  seeds = _seeds(seed, len(starts))
+  def resample_chunk(chunk):
+    start, chunk_seed = chunk
+    count = min(chunk_size, n - start)
+    return _ks_resample.bootstrap_ks(data1, sample1, data2, sample2, count, chunk_seed)
+  stats_out = thread_tools.thread_map(resample_chunk, zip(starts, seeds), threads)
+  if len(stats_out) == 0:
+    return numpy.zeros(0)
+  stats_out = numpy.concatenate(stats_out)
   stats_out.sort()
   return stats_out
 
-def bootstrap_ks_n_pops(pops, n):
-  ri = numpy.random.randint
+def _seeds(seed, count):
+  if seed is None:
+    random = numpy.random
+  else:
+    random = numpy.random.RandomState(seed)
+  return [int(s) for s in random.randint(0, 2**31 - 1, size=count)]
+
+def bootstrap_ks_1_pop(pop, n, seed = None, threads = None):
+  l = len(pop) / 2
+  return bootstrap_ks(pop[:l], pop[:l], n, seed=seed, threads=threads)
+
+def bootstrap_ks_n_pops(pops, n, seed = None, threads = None):
   stats_out = []
   l = len(pops)
   n_each = n/(l*(l-1)/2)
+  seeds = iter(_seeds(seed, l*(l-1)/2))
   for i, j in numpy.ndindex((l,l)):
     if i >= j: continue
-    p1, p2 = pops[i], pops[j]
-    l1, l2 = len(p1), len(p2)
-    stats_out += [ks_stat(p1[ri(l1, size=l1)], p2[ri(l2, size=l2)]) for i in range(n_each)]
+    stats_out.append(bootstrap_ks(pops[i], pops[j], n_each, seed=seeds.next(), threads=threads))
+  stats_out = numpy.concatenate(stats_out)
   stats_out.sort()
   return stats_out
 
@@ -38,28 +77,28 @@ def bootstrap_onetail_pval(stat, dist):
   index = numpy.searchsorted(dist, stat)
   return float(len(dist) - index) / len(dist)
 
-def symmetric_comparison(pops, n=100000):
+def symmetric_comparison(pops, n=100000, seed=None, threads=None):
   ref_ks_vals = []
-  for pop in pops:
-    ref_ks_vals.append(bootstrap_ks_1_pop(pop, n))
+  for pop, pop_seed in zip(pops, _seeds(seed, len(pops))):
+    ref_ks_vals.append(bootstrap_ks_1_pop(pop, n, pop_seed, threads))
   l = len(pops)
   pvals = numpy.zeros((l, l))
   for i, j in numpy.ndindex((l,l)):
     if i >= j: continue
     p1, p2 = pops[i], pops[j]
     r1, r2 = ref_ks_vals[i], ref_ks_vals[j]
-    r = r1+r2
+    r = numpy.concatenate([r1, r2])
     r.sort()
     ks = ks_stat(p1, p2)
     p = bootstrap_onetail_pval(ks, r)
     pvals[i,j] = pvals[j,i] = p 
   return pvals
 
-def compare_to_ref(pops, refs, n=100000):
+def compare_to_ref(pops, refs, n=100000, seed=None, threads=None):
   if len(refs) > 1:
-    r = bootstrap_ks_n_pops(refs, n)
+    r = bootstrap_ks_n_pops(refs, n, seed, threads)
   else:
-    r = bootstrap_ks_1_pop(refs[0], n)
+    r = bootstrap_ks_1_pop(refs[0], n, seed, threads)
   all_refs = numpy.concatenate(refs)
   pvals = []
   for pop in pops:
@@ -29,6 +29,9 @@
 # SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 import types
+import os
+import sys
+import threading
 import numpy
 
 def _extend_mode_to_code(mode):
@@ -90,9 +93,63 @@ def _get_output(output, input, output_type = None, shape = None):
         return_value = None
     return output, return_value
 
+def _prefilter_type(output):
+    """Return the type in which to store the spline coefficients for
+    interpolation into the given output array: single precision suffices
+    for single-precision outputs and integer outputs of at most 16 bits,
+    and halves the memory used.
+    """
+    if output.dtype == numpy.float32 or output.dtype.itemsize <= 2:
+        return numpy.float32
+    return numpy.float64
+
 def _check_axis(axis, rank):
     if axis < 0:
         axis += rank
     if axis < 0 or axis >= rank:
         raise ValueError, 'invalid axis'
     return axis
+
+def _cpu_count():
+    """Return the number of processors, or 1 if it cannot be determined.
+    """
+    try:
+        return max(1, int(os.sysconf('SC_NPROCESSORS_ONLN')))
+    except (AttributeError, ValueError, OSError):
+        try:
+            return max(1, int(os.environ['NUMBER_OF_PROCESSORS']))
+        except (KeyError, ValueError):
+            return 1
+
+# outputs are not divided into blocks smaller than this many elements
+_min_block_size = 16384
+
+def _run_in_blocks(function, length, size, threads = None):
+    """Call function(start, stop) on contiguous blocks that together cover
+    range(length), one block per thread. 'size' is the total number of
+    output elements, so that small outputs are not divided up needlessly.
+    If threads is None, one thread per processor is used. The function
+    should release the interpreter lock while it computes.
+    """
+    if threads is None:
+        threads = _cpu_count()
+    blocks = max(1, min(int(threads), length, size // _min_block_size))
+    if blocks == 1:
+        function(0, length)
+        return
+    bounds = [(length * i) // blocks for i in range(blocks + 1)]
+    errors = []
+    def run(start, stop):
+        try:
+            function(start, stop)
+        except:
+            errors.append(sys.exc_info())
+    workers = [threading.Thread(target = run, args = (bounds[i], bounds[i + 1]))
+               for i in range(blocks)]
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    if errors:
+        exc_type, value, traceback = errors[0]
+        raise exc_type, value, traceback
@@ -72,7 +72,7 @@ def convolve1d(input, weights, axis = -1, output = None, mode = "reflect",
     return correlate1d(input, weights, axis, output, mode, cval, origin)
 
 def gaussian_filter1d(input, sigma, axis = -1, order = 0, output = None,
-                      mode = "reflect", cval = 0.0):
+                      mode = "reflect", cval = 0.0, method = "kernel"):
     """One-dimensional Gaussian filter.
 
     The standard-deviation of the Gaussian filter is given by
@@ -80,7 +80,30 @@ def gaussian_filter1d(input, sigma, axis = -1, order = 0, output = None,
     kernel. An order of 1, 2, or 3 corresponds to convolution with the
     first, second or third derivatives of a Gaussian. Higher order
     derivatives are not implemented.
+
+    If method is "kernel", the input is correlated with a sampled
+    Gaussian kernel 8 sigma wide, which takes time proportional to sigma.
+    If method is "recursive", the fourth-order recursive approximations
+    of Deriche to the Gaussian and its first and second derivatives are
+    used, which take the same time for any sigma, and so are much faster
+    for large sigma. For sigma of 0.7 or more, they are accurate to about
+    0.3% of the peak of the kernel for the Gaussian and its first
+    derivative, and 1.5% for the second derivative. For smaller sigma,
+    and for the third derivative, the kernel is used.
     """
+    if method == "recursive":
+        if sigma >= 0.7 and order in [0, 1, 2]:
+            input = numpy.asarray(input)
+            if numpy.iscomplexobj(input):
+                raise TypeError, 'Complex type not supported'
+            output, return_value = _ni_support._get_output(output, input)
+            axis = _ni_support._check_axis(axis, input.ndim)
+            mode = _ni_support._extend_mode_to_code(mode)
+            _nd_image.recursive_gaussian1d(input, float(sigma), order, axis,
+                                           output, mode, cval)
+            return return_value
+    elif method != "kernel":
+        raise ValueError, 'method must be "kernel" or "recursive"'
     sd = float(sigma)
     # make the length of the filter equal to 4 times the standard
     # deviations:
@@ -123,7 +146,7 @@ def gaussian_filter1d(input, sigma, axis = -1, order = 0, output = None,
     return correlate1d(input, weights, axis, output, mode, cval, 0)
 
 def gaussian_filter(input, sigma, order = 0, output = None,
-                  mode = "reflect", cval = 0.0):
+                  mode = "reflect", cval = 0.0, method = "kernel"):
     """Multi-dimensional Gaussian filter.
 
     The standard-deviations of the Gaussian filter are given for each
@@ -133,7 +156,8 @@ def gaussian_filter(input, sigma, order = 0, output = None,
     of 0 corresponds to convolution with a Gaussian kernel. An order
     of 1, 2, or 3 corresponds to convolution with the first, second or
     third derivatives of a Gaussian. Higher order derivatives are not
-    implemented.'
+    implemented.' The method may be "kernel" or "recursive"; see
+    gaussian_filter1d.
 
     Note: The multi-dimensional filter is implemented as a sequence of
     one-dimensional convolution filters. The intermediate arrays are
@@ -152,7 +176,7 @@ def gaussian_filter(input, sigma, order = 0, output = None,
     if len(axes) > 0:
         for axis, sigma, order in axes:
             gaussian_filter1d(input, sigma, axis, order, output,
-                              mode, cval)
+                              mode, cval, method)
             input = output
     else:
         output[...] = input[...]
@@ -511,7 +535,8 @@ def maximum_filter(input, size = None, footprint = None, output = None,
 
 
 def _rank_filter(input, rank, size = None, footprint = None, output = None,
-     mode = "reflect", cval = 0.0, origin = 0, operation = 'rank'):
+     mode = "reflect", cval = 0.0, origin = 0, operation = 'rank',
+     threads = None):
     input = numpy.asarray(input)
     if numpy.iscomplexobj(input):
         raise TypeError, 'Complex type not supported'
@@ -557,12 +582,44 @@ def _rank_filter(input, rank, size = None, footprint = None, output = None,
     else:
         output, return_value = _ni_support._get_output(output, input)
         mode = _ni_support._extend_mode_to_code(mode)
-        _nd_image.rank_filter(input, rank, footprint, output, mode, cval,
-                              origins)
+        if _histogram_rank_filter_applies(input, footprint, output, mode,
+                                          cval, origins):
+            def filter(start, stop):
+                _nd_image.histogram_rank_filter(input, rank, footprint.shape,
+                           output[start:stop], mode, cval, origins, start)
+            _ni_support._run_in_blocks(filter, output.shape[0], output.size,
+                                       threads)
+        else:
+            _nd_image.rank_filter(input, rank, footprint, output, mode, cval,
+                                  origins)
         return return_value
 
+# footprints smaller than this are faster to select from directly
+_min_histogram_footprint = 9
+
+def _histogram_rank_filter_applies(input, footprint, output, mode, cval,
+                                   origins):
+    """Return whether the rank filter can use the sliding histograms of
+    _nd_image.histogram_rank_filter: a 2D UInt8 or UInt16 image of the
+    same type as the output, a large enough rectangular footprint, and a
+    constant value (if used) that is one of the image values.
+    """
+    if input.ndim != 2 or input.dtype.type not in [numpy.uint8, numpy.uint16]:
+        return False
+    if output.dtype != input.dtype or not footprint.all():
+        return False
+    if footprint.size < _min_histogram_footprint:
+        return False
+    for origin, lenf in zip(origins, footprint.shape):
+        if lenf // 2 + origin >= lenf:
+            return False
+    if mode == _ni_support._extend_mode_to_code('constant'):
+        if cval != int(cval) or not 0 <= cval <= numpy.iinfo(input.dtype).max:
+            return False
+    return True
+
 def rank_filter(input, rank, size = None, footprint = None, output = None,
-      mode = "reflect", cval = 0.0, origin = 0):
+      mode = "reflect", cval = 0.0, origin = 0, threads = None):
     """Calculates a multi-dimensional rank filter.
 
     The rank parameter may be less then zero, i.e., rank = -1
@@ -571,12 +628,16 @@ def rank_filter(input, rank, size = None, footprint = None, output = None,
     provided. The origin parameter controls the placement of the
     filter. The mode parameter determines how the array borders are
     handled, where cval is the value when mode is equal to 'constant'.
+    Two-dimensional UInt8 and UInt16 images with rectangular footprints
+    are filtered with sliding histograms, in time nearly independent of
+    the footprint size, divided among the given number of threads (one
+    per processor if None).
     """
     return _rank_filter(input, rank, size, footprint, output, mode, cval,
-                        origin, 'rank')
+                        origin, 'rank', threads)
 
 def median_filter(input, size = None, footprint = None, output = None,
-      mode = "reflect", cval = 0.0, origin = 0):
+      mode = "reflect", cval = 0.0, origin = 0, threads = None):
     """Calculates a multi-dimensional median filter.
 
     Either a size or a footprint with the filter must be provided. An
@@ -584,12 +645,14 @@ def median_filter(input, size = None, footprint = None, output = None,
     controls the placement of the filter. The mode parameter
     determines how the array borders are handled, where cval is the
     value when mode is equal to 'constant'.
+    See rank_filter for the threads parameter.
     """
     return _rank_filter(input, 0, size, footprint, output, mode, cval,
-                        origin, 'median')
+                        origin, 'median', threads)
 
 def percentile_filter(input, percentile, size = None, footprint = None,
-                 output = None, mode = "reflect", cval = 0.0, origin = 0):
+                 output = None, mode = "reflect", cval = 0.0, origin = 0,
+                 threads = None):
     """Calculates a multi-dimensional percentile filter.
 
     The percentile parameter may be less then zero, i.e., percentile =
@@ -598,9 +661,10 @@ def percentile_filter(input, percentile, size = None, footprint = None,
     provided. The origin parameter controls the placement of the
     filter. The mode parameter determines how the array borders are
     handled, where cval is the value when mode is equal to 'constant'.
+    See rank_filter for the threads parameter.
     """
     return _rank_filter(input, percentile, size, footprint, output, mode,
-                                   cval, origin, 'percentile')
+                                   cval, origin, 'percentile', threads)
 
 def generic_filter1d(input, function, filter_size, axis = -1,
                  output = None, mode = "reflect", cval = 0.0, origin = 0,
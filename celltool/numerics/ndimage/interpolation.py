@@ -53,6 +53,10 @@ def spline_filter1d(input, order = 3, axis = -1, output = numpy.float64,
         output[...] = numpy.array(input)
     else:
         axis = _ni_support._check_axis(axis, input.ndim)
+        if output.dtype == numpy.float32 and input is not output:
+            # single-precision arrays are filtered fastest in place
+            output[...] = input
+            input = output
         _nd_image.spline_filter1d(input, order, axis, output)
     return return_value
 
@@ -66,6 +70,8 @@ def spline_filter(input, order = 3, output = numpy.float64,
     in the same data type as the output. Therefore, for output types
     with a limited precision, the results may be imprecise because
     intermediate results may be stored with insufficient precision.
+    Single-precision (float32) outputs are filtered in single precision,
+    several lines at a time, which is considerably faster.
     """
     if order < 2 or order > 5:
         raise RuntimeError, 'spline order not supported'
@@ -127,19 +133,21 @@ def geometric_transform(input, mapping, output_shape = None,
     if input.ndim < 1 or len(output_shape) < 1:
         raise RuntimeError, 'input and output rank must be > 0'
     mode = _ni_support._extend_mode_to_code(mode)
+    output, return_value = _ni_support._get_output(output, input,
+                                        output_type, shape = output_shape)
     if prefilter and order > 1:
-        filtered = spline_filter(input, order, output = numpy.float64)
+        filtered = spline_filter(input, order,
+                            output = _ni_support._prefilter_type(output))
     else:
         filtered = input
-    output, return_value = _ni_support._get_output(output, input,
-                                        output_type, shape = output_shape)
     _nd_image.geometric_transform(filtered, mapping, None, None, None,
                output, order, mode, cval, extra_arguments, extra_keywords)
     return return_value
 
 
 def map_coordinates(input, coordinates, output_type = None, output = None,
-                order = 3, mode = 'constant', cval = 0.0, prefilter = True):
+                order = 3, mode = 'constant', cval = 0.0, prefilter = True,
+                threads = None):
     """Apply an arbritrary coordinate transformation.
 
     The array of coordinates is used to find, for each point in the output,
@@ -160,6 +168,8 @@ def map_coordinates(input, coordinates, output_type = None, output = None,
     parameter prefilter determines if the input is pre-filtered before
     interpolation (necessary for spline interpolation of order >
     1). If False it is assumed that the input is already filtered.
+    The output is divided along its first axis among the given number
+    of threads (if None, one per processor).
 
     Example usage:
       >>> a = arange(12.).reshape((4,3))
@@ -189,20 +199,24 @@ def map_coordinates(input, coordinates, output_type = None, output = None,
     if coordinates.shape[0] != input.ndim:
         raise RuntimeError, 'invalid shape for coordinate array'
     mode = _ni_support._extend_mode_to_code(mode)
+    output, return_value = _ni_support._get_output(output, input,
+                                        output_type, shape = output_shape)
     if prefilter and order > 1:
-        filtered = spline_filter(input, order, output = numpy.float64)
+        filtered = spline_filter(input, order,
+                            output = _ni_support._prefilter_type(output))
     else:
         filtered = input
-    output, return_value = _ni_support._get_output(output, input,
-                                        output_type, shape = output_shape)
-    _nd_image.geometric_transform(filtered, None, coordinates, None, None,
-               output, order, mode, cval, None, None)
+    def transform(start, stop):
+        _nd_image.geometric_transform(filtered, None, coordinates[:, start:stop],
+               None, None, output[start:stop], order, mode, cval, None, None)
+    _ni_support._run_in_blocks(transform, output.shape[0], output.size, threads)
     return return_value
 
 
 def affine_transform(input, matrix, offset = 0.0, output_shape = None,
                      output_type = None, output = None, order = 3,
-                     mode = 'constant', cval = 0.0, prefilter = True):
+                     mode = 'constant', cval = 0.0, prefilter = True,
+                     threads = None):
     """Apply an affine transformation.
 
     The given matrix and offset are used to find for each point in the
@@ -219,6 +233,8 @@ def affine_transform(input, matrix, offset = 0.0, output_shape = None,
     one-dimensional sequence or array. In the latter case, it is
     assumed that the matrix is diagonal. A more efficient algorithms
     is then applied that exploits the separability of the problem.
+    Otherwise, the output is divided along its first axis among the
+    given number of threads (if None, one per processor).
     """
     if order < 0 or order > 5:
         raise RuntimeError, 'spline order not supported'
@@ -230,12 +246,13 @@ def affine_transform(input, matrix, offset = 0.0, output_shape = None,
     if input.ndim < 1 or len(output_shape) < 1:
         raise RuntimeError, 'input and output rank must be > 0'
     mode = _ni_support._extend_mode_to_code(mode)
+    output, return_value = _ni_support._get_output(output, input,
+                                        output_type, shape = output_shape)
     if prefilter and order > 1:
-        filtered = spline_filter(input, order, output = numpy.float64)
+        filtered = spline_filter(input, order,
+                            output = _ni_support._prefilter_type(output))
     else:
         filtered = input
-    output, return_value = _ni_support._get_output(output, input,
-                                        output_type, shape = output_shape)
     matrix = numpy.asarray(matrix, dtype = numpy.float64)
     if matrix.ndim not in [1, 2] or matrix.shape[0] < 1:
         raise RuntimeError, 'no proper affine matrix provided'
@@ -255,8 +272,13 @@ def affine_transform(input, matrix, offset = 0.0, output_shape = None,
         _nd_image.zoom_shift(filtered, matrix, offset, output, order,
                              mode, cval)
     else:
-        _nd_image.geometric_transform(filtered, None, None, matrix, offset,
-                            output, order, mode, cval, None, None)
+        def transform(start, stop):
+            # the output coordinates of each block start from zero
+            _nd_image.geometric_transform(filtered, None, None, matrix,
+                            offset + matrix[:, 0] * start, output[start:stop],
+                            order, mode, cval, None, None)
+        _ni_support._run_in_blocks(transform, output.shape[0], output.size,
+                                   threads)
     return return_value
 
 
@@ -278,12 +300,13 @@ def shift(input, shift, output_type = None, output = None, order = 3,
     if input.ndim < 1:
         raise RuntimeError, 'input and output rank must be > 0'
     mode = _ni_support._extend_mode_to_code(mode)
+    output, return_value = _ni_support._get_output(output, input,
+                                                    output_type)
     if prefilter and order > 1:
-        filtered = spline_filter(input, order, output = numpy.float64)
+        filtered = spline_filter(input, order,
+                            output = _ni_support._prefilter_type(output))
     else:
         filtered = input
-    output, return_value = _ni_support._get_output(output, input,
-                                                    output_type)
     shift = _ni_support._normalize_sequence(shift, input.ndim)
     shift = [-ii for ii in shift]
     shift = numpy.asarray(shift, dtype = numpy.float64)
@@ -311,15 +334,16 @@ def zoom(input, zoom, output_type = None, output = None, order = 3,
     if input.ndim < 1:
         raise RuntimeError, 'input and output rank must be > 0'
     mode = _ni_support._extend_mode_to_code(mode)
-    if prefilter and order > 1:
-        filtered = spline_filter(input, order, output = numpy.float64)
-    else:
-        filtered = input
     zoom = _ni_support._normalize_sequence(zoom, input.ndim)
     output_shape = [int(ii * jj) for ii, jj in zip(input.shape, zoom)]
     zoom = [1.0 / ii for ii in zoom]
     output, return_value = _ni_support._get_output(output, input,
                                         output_type, shape = output_shape)
+    if prefilter and order > 1:
+        filtered = spline_filter(input, order,
+                            output = _ni_support._prefilter_type(output))
+    else:
+        filtered = input
     zoom = numpy.asarray(zoom, dtype = numpy.float64)
     if not zoom.flags.contiguous:
         zoom = shift.copy()
@@ -35,7 +35,7 @@ import _ni_support
 import _nd_image
 import morphology
 
-def label(input, structure = None, output = None):
+def label(input, structure = None, output = None, threads = None):
     """Label an array of objects.
 
     The structure that defines the object connections must be
@@ -44,6 +44,12 @@ def label(input, structure = None, output = None):
     returns a tuple consisting of the array of labels and the number
     of objects found. If an output array is provided only the number of
     objects found is returned.
+
+    The array is divided along its first axis into blocks that are
+    labeled on the given number of threads (one per processor if None).
+    The objects that meet across the boundaries between blocks are then
+    merged, so that the labels are the same as those of a single pass: the
+    objects are numbered in the order in which they are first met.
     """
     input = numpy.asarray(input)
     if numpy.iscomplexobj(input):
@@ -64,12 +70,56 @@ def label(input, structure = None, output = None):
     else:
         output = numpy.int32
     output, return_value = _ni_support._get_output(output, input)
-    max_label = _nd_image.label(input, structure, output)
+    if input.ndim == 0:
+        max_label = _nd_image.label(input, structure, output)
+    else:
+        max_label = _label_blocks(input, structure, output, threads)
     if return_value == None:
         return max_label
     else:
         return return_value, max_label
 
+def _label_blocks(input, structure, output, threads):
+    counts = {}
+    def label_block(start, stop):
+        counts[start] = _nd_image.label(input[start:stop], structure,
+                                        output[start:stop])
+    _ni_support._run_in_blocks(label_block, output.shape[0], output.size,
+                               threads)
+    if len(counts) == 1:
+        return counts[0]
+    # the labels of each block are numbered after those of the blocks
+    # before it; objects are merged in a union-find forest in which each
+    # label points to a lower label of the same object
+    starts = counts.keys()
+    starts.sort()
+    offsets = {}
+    total = 0
+    for start in starts:
+        offsets[start] = total
+        total += counts[start]
+    parents = numpy.arange(total + 1, dtype = numpy.int32)
+    for start in starts[1:]:
+        previous = starts[starts.index(start) - 1]
+        _nd_image.label_merge(output[start - 1:start + 1], structure,
+                              offsets[previous], offsets[start], parents)
+    while True:
+        grandparents = parents[parents]
+        if (grandparents == parents).all():
+            break
+        parents = grandparents
+    # each object is numbered in order of its lowest label
+    numbers = numpy.cumsum(parents == numpy.arange(total + 1)) - 1
+    numbers = numbers[parents].astype(numpy.int32)
+    def relabel_block(start, stop):
+        offset = offsets[start]
+        map = numbers[offset:offset + counts[start] + 1].copy()
+        map[0] = 0
+        _nd_image.relabel(output[start:stop], map)
+    _ni_support._run_in_blocks(relabel_block, output.shape[0], output.size,
+                               threads)
+    return int(numbers.max())
+
 def find_objects(input, max_label = 0):
     """Find objects in a labeled array.
 
@@ -304,6 +354,173 @@ def center_of_mass(input, labels = None, index = None):
     return _nd_image.center_of_mass(input, labels, index)
 
 
+# features computed by label_statistics, and the optional parts of the
+# statistics records (described in ni_measure.h) that each needs
+_label_features = {'count': 0, 'sum': 0, 'mean': 0, 'sum_of_squares': 0,
+                   'variance': 0, 'standard_deviation': 0, 'minimum': 1,
+                   'maximum': 1, 'minimum_position': 1,
+                   'maximum_position': 1, 'centroid': 2,
+                   'center_of_mass': 2, 'second_moments': 2,
+                   'bounding_box': 4}
+
+def label_statistics(input, labels, index = None, features = None,
+                     threads = None):
+    """Calculate several statistics of labeled objects in a single pass.
+
+    The index parameter is a single label number or a sequence of label
+    numbers of the objects to be measured; if it is None, the objects
+    labeled 1 to labels.max() are. The features parameter is a sequence
+    of the names of the statistics to calculate (all of them if None):
+      count, sum, mean, sum_of_squares, variance, standard_deviation:
+        of the values of the object, as the functions of those names.
+      minimum, maximum: of the values, as the functions of those names.
+      minimum_position, maximum_position: the coordinates of the first
+        minimum or maximum, shape (rank,) for each object.
+      centroid: the mean coordinates of the object, shape (rank,).
+      center_of_mass: the mean coordinates weighted by the values, as
+        center_of_mass, shape (rank,).
+      second_moments: the covariance matrix of the coordinates, weighted
+        by the values, about the center of mass, shape (rank, rank).
+      bounding_box: the lowest and one past the highest coordinate of
+        the object along each axis, shape (rank, 2), as from find_objects.
+    A dictionary of the statistics is returned, each an array with one
+    entry for each object (or a single entry for a single index). Objects
+    with no elements have statistics of zero.
+
+    The array is divided along its first axis into blocks, which are
+    measured on the given number of threads (one per processor if None)
+    and merged. Variances are calculated from sums of squares rather than
+    in a second pass.
+    """
+    input = numpy.asarray(input)
+    if numpy.iscomplexobj(input):
+        raise TypeError, 'Complex type not supported'
+    labels = numpy.asarray(labels)
+    labels = _broadcast(labels, input.shape)
+    if labels.shape != input.shape:
+        raise RuntimeError, 'input and labels shape are not equal'
+    if input.ndim < 1:
+        raise RuntimeError, 'input rank must be > 0'
+    if features is None:
+        features = _label_features.keys()
+    parts = 0
+    for feature in features:
+        if feature not in _label_features:
+            raise ValueError, 'unknown feature: %s' % feature
+        parts |= _label_features[feature]
+    single = index is not None and numpy.isscalar(index)
+    if index is None:
+        index = range(1, max(int(labels.max()), 0) + 1)
+    elif single:
+        index = [index]
+    index = [int(ii) for ii in index]
+    if len(index) == 0:
+        records = numpy.zeros((0, _label_record_size(input.ndim)),
+                              numpy.float64)
+    else:
+        blocks = {}
+        def measure(start, stop):
+            blocks[start] = _nd_image.label_statistics(input[start:stop],
+                                      labels[start:stop], index, parts, start)
+        _ni_support._run_in_blocks(measure, input.shape[0], input.size,
+                                   threads)
+        starts = blocks.keys()
+        starts.sort()
+        records = blocks[starts[0]]
+        for start in starts[1:]:
+            records = _merge_label_records(records, blocks[start],
+                                           input.ndim)
+    result = _label_statistics_from_records(records, input.shape, features)
+    if single:
+        for feature in result.keys():
+            result[feature] = result[feature][0]
+    return result
+
+def _label_record_size(rank):
+    return 7 + 4 * rank + rank * (rank + 1) // 2
+
+def _merge_label_records(first, second, rank):
+    """Merge the statistics records of two consecutive blocks of an array.
+    """
+    box = _label_record_size(rank) - 2 * rank
+    merged = first.copy()
+    merged[:, :3] += second[:, :3]
+    merged[:, 7:box] += second[:, 7:box]
+    # the extrema of the first block win ties, as in a single pass
+    for value, position, compare in [(3, 5, numpy.less),
+                                      (4, 6, numpy.greater)]:
+        better = compare(second[:, value], first[:, value])
+        merged[:, value] = numpy.where(better, second[:, value],
+                                       first[:, value])
+        merged[:, position] = numpy.where(better, second[:, position],
+                                          first[:, position])
+    merged[:, box:box + rank] = numpy.minimum(first[:, box:box + rank],
+                                              second[:, box:box + rank])
+    merged[:, box + rank:] = numpy.maximum(first[:, box + rank:],
+                                           second[:, box + rank:])
+    return merged
+
+def _label_statistics_from_records(records, shape, features):
+    rank = len(shape)
+    count = records[:, 0]
+    present = count > 0
+    # divisors that are safe for objects with no elements
+    n = numpy.where(present, count, 1)
+    result = {}
+    total = records[:, 1]
+    for feature in features:
+        if feature == 'count':
+            result[feature] = count.astype(numpy.int_)
+        elif feature == 'sum':
+            result[feature] = total
+        elif feature == 'mean':
+            result[feature] = total / n
+        elif feature == 'sum_of_squares':
+            result[feature] = records[:, 2]
+        elif feature in ['variance', 'standard_deviation']:
+            variance = (records[:, 2] - total * total / n) / numpy.where(
+                count > 1, count - 1, 1)
+            variance = numpy.where(count > 1, numpy.maximum(variance, 0), 0)
+            if feature == 'variance':
+                result[feature] = variance
+            else:
+                result[feature] = numpy.sqrt(variance)
+        elif feature in ['minimum', 'maximum']:
+            column = {'minimum': 3, 'maximum': 4}[feature]
+            result[feature] = numpy.where(present, records[:, column], 0)
+        elif feature in ['minimum_position', 'maximum_position']:
+            column = {'minimum_position': 5, 'maximum_position': 6}[feature]
+            positions = records[:, column].astype(numpy.int_)
+            result[feature] = numpy.transpose(_index_to_position(positions,
+                                                                 shape))
+        elif feature == 'centroid':
+            result[feature] = records[:, 7:7 + rank] / n[:, numpy.newaxis]
+        elif feature in ['center_of_mass', 'second_moments']:
+            mass = numpy.where(total != 0, total, 1)[:, numpy.newaxis]
+            center = records[:, 7 + rank:7 + 2 * rank] / mass
+            if feature == 'center_of_mass':
+                result[feature] = center
+            else:
+                moments = numpy.zeros((len(records), rank, rank),
+                                      numpy.float64)
+                column = 7 + 2 * rank
+                for kk in range(rank):
+                    for ll in range(kk, rank):
+                        moment = (records[:, column] / mass[:, 0] -
+                                  center[:, kk] * center[:, ll])
+                        moments[:, kk, ll] = moments[:, ll, kk] = moment
+                        column += 1
+                result[feature] = moments
+        elif feature == 'bounding_box':
+            box = _label_record_size(rank) - 2 * rank
+            lowest = numpy.where(present[:, numpy.newaxis],
+                                 records[:, box:box + rank], 0)
+            highest = numpy.where(present[:, numpy.newaxis],
+                                  records[:, box + rank:] + 1, 0)
+            result[feature] = numpy.array([lowest, highest]).astype(
+                numpy.int_).transpose((1, 2, 0))
+    return result
+
 def histogram(input, min, max, bins, labels = None, index = None):
     """Calculate a histogram of of the array.
 
@@ -114,6 +114,15 @@ def _binary_erosion(input, structure, iterations, mask, output,
         output = bool
     output, return_value = _ni_support._get_output(output, input)
 
+    if _packed_morphology_applies(input, output):
+        connectivity = _propagation_connectivity(structure, origin)
+        if invert and iterations < 1 and connectivity:
+            _nd_image.binary_propagation_packed(input, mask, output,
+                                        border_value, connectivity == 2)
+        else:
+            _nd_image.binary_erosion_packed(input, structure, mask, output,
+                                    border_value, origin, invert, iterations)
+        return return_value
 
     if iterations == 1:
         _nd_image.binary_erosion(input, structure, mask, output,
@@ -159,6 +168,24 @@ def _binary_erosion(input, structure, iterations, mask, output,
             return tmp_out
 
 
+def _packed_morphology_applies(input, output):
+    """Return whether _nd_image can erode the input packed 64 elements to
+    a machine word: a non-empty 2D input and a boolean output.
+    """
+    return input.ndim == 2 and input.size > 0 and output.dtype == bool
+
+def _propagation_connectivity(structure, origin):
+    """Return 1 or 2 if a centered 3x3 structure connects the 4 or the 8
+    neighbours of a 2D element, which _nd_image can propagate in raster
+    passes, or None otherwise.
+    """
+    if structure.shape != (3, 3) or origin[0] or origin[1]:
+        return None
+    for connectivity in (1, 2):
+        if (structure == generate_binary_structure(2, connectivity)).all():
+            return connectivity
+    return None
+
 def binary_erosion(input, structure = None, iterations = 1, mask = None,
         output = None, border_value = 0, origin = 0, brute_force = False):
     """Multi-dimensional binary erosion with the given structure.
@@ -291,7 +318,10 @@ def binary_propagation(input, structure = None, mask = None,
 
     This function is functionally equivalent to calling binary_dilation
     with the number of iterations less then one: iterative dilation until
-    the result does not change anymore.
+    the result does not change anymore. For 2D arrays and a boolean
+    output the elements are packed 64 to a machine word, and with a
+    structure of connectivity one or two the propagation is done in
+    alternating forward and backward passes instead of by dilations.
     """
     return binary_dilation(input, structure, -1, mask, output,
                            border_value, origin)
@@ -702,7 +732,8 @@ def distance_transform_cdt(input, structure = 'chessboard',
 
 def distance_transform_edt(input, sampling = None,
                         return_distances = True, return_indices = False,
-                        distances = None, indices = None):
+                        distances = None, indices = None,
+                        dtype = numpy.float64, threads = None):
     """Exact euclidean distance transform.
 
     In addition to the distance transform, the feature transform can
@@ -719,59 +750,110 @@ def distance_transform_edt(input, sampling = None,
     to be equal along all axes.
 
     the distances and indices arguments can be used to give optional
-    output arrays that must be of the correct size and type (float64
-    and int32).
+    output arrays that must be of the correct size and type (float64 or
+    float32, and int32). Otherwise the distances are returned with the
+    given dtype, which may be float32 to halve their memory.
+
+    The transform is separable: each axis in turn replaces the squared
+    distances along its lines by the lower envelope of parabolas
+    (Felzenszwalb and Huttenlocher). The lines of each pass are divided
+    over the given number of threads, by default one per processor.
+    Only the distances are stored unless the indices are requested.
     """
     if (not return_distances) and (not return_indices):
         msg = 'at least one of distances/indices must be specified'
         raise RuntimeError, msg
     ft_inplace = isinstance(indices, numpy.ndarray)
     dt_inplace = isinstance(distances, numpy.ndarray)
-    # calculate the feature transform
-    input = numpy.where(input, 1, 0).astype(numpy.int8)
-    if sampling is not None:
+    input = numpy.asarray(input)
+    if sampling is None:
+        sampling = [1.0] * input.ndim
+    else:
         sampling = _ni_support._normalize_sequence(sampling, input.ndim)
-        sampling = numpy.asarray(sampling, dtype = numpy.float64)
-        if not sampling.flags.contiguous:
-            sampling = sampling.copy()
-    if ft_inplace:
-        ft = indices
-        if ft.shape != (input.ndim,) + input.shape:
-            raise RuntimeError, 'indices has wrong shape'
-        if ft.dtype.type != numpy.int32:
-            raise RuntimeError, 'indices must be of int32 type'
+        sampling = [float(s) for s in sampling]
+    if return_distances and dt_inplace:
+        dt = distances
+        if dt.shape != input.shape:
+            raise RuntimeError, 'distances has wrong shape'
     else:
-        ft = numpy.zeros((input.ndim,) + input.shape,
-                            dtype = numpy.int32)
-    _nd_image.euclidean_feature_transform(input, sampling, ft)
-    # if requested, calculate the distance transform
-    if return_distances:
-        dt = ft - numpy.indices(input.shape, dtype = ft.dtype)
-        dt = dt.astype(numpy.float64)
-        if sampling is not None:
-            for ii in range(len(sampling)):
-                dt[ii, ...] *= sampling[ii]
-        numpy.multiply(dt, dt, dt)
-        if dt_inplace:
-            dt = numpy.add.reduce(dt, axis = 0)
-            if distances.shape != dt.shape:
+        dt = numpy.zeros(input.shape, dtype)
+    if dt.dtype.type not in [numpy.float32, numpy.float64]:
+        raise RuntimeError, 'distances must be of float32 or float64 type'
+    # squared distances, infinite until a background element is seen
+    background = input == 0
+    dt[...] = numpy.inf
+    dt[background] = 0
+    if return_indices:
+        if ft_inplace:
+            if indices.shape != (input.ndim,) + input.shape:
                 raise RuntimeError, 'indices has wrong shape'
-            if distances.dtype.type != numpy.float64:
-                raise RuntimeError, 'indices must be of float64 type'
-            numpy.sqrt(dt, distances)
-            del dt
-        else:
-            dt = numpy.add.reduce(dt, axis = 0)
-            dt = numpy.sqrt(dt)
+            if indices.dtype.type != numpy.int32:
+                raise RuntimeError, 'indices must be of int32 type'
+        # flat indices of the closest background elements
+        ft = numpy.arange(input.size, dtype = numpy.int32)
+        ft = ft.reshape(input.shape)
+        ft[~background] = -1
+    else:
+        ft = None
+    del background
+    for axis in range(input.ndim):
+        _distance_lines(dt, ft, axis, sampling[axis], threads)
+    if return_distances:
+        numpy.sqrt(dt, dt)
+    if return_indices:
+        if not ft_inplace:
+            indices = numpy.zeros((input.ndim,) + input.shape,
+                                  dtype = numpy.int32)
+        for ii in range(input.ndim - 1, -1, -1):
+            indices[ii, ...] = ft % input.shape[ii]
+            ft //= input.shape[ii]
     # construct and return the result
     result = []
     if return_distances and not dt_inplace:
         result.append(dt)
     if return_indices and not ft_inplace:
-        result.append(ft)
+        result.append(indices)
     if len(result) == 2:
         return tuple(result)
     elif len(result) == 1:
         return result[0]
     else:
         return None
+
+def _distance_lines(dt, ft, axis, sampling, threads):
+    """One pass of the separable euclidean distance transform along the
+    given axis, the lines divided over threads along another axis.
+    """
+    if dt.ndim == 1:
+        threads = 1
+    split = 0
+    if axis == 0 and dt.ndim > 1:
+        split = 1
+    def transform(start, stop):
+        region = [slice(None)] * dt.ndim
+        region[split] = slice(start, stop)
+        region = tuple(region)
+        if ft is None:
+            features = None
+        else:
+            features = ft[region]
+        _nd_image.euclidean_distance_lines(dt[region], features, axis,
+                                           sampling)
+    _ni_support._run_in_blocks(transform, dt.shape[split], dt.size, threads)
+
+def euclidean_distance_lines(squared, axis, sampling = 1.0, features = None):
+    """One pass of the separable exact euclidean distance transform.
+
+    The squared distances (a float32 or float64 array, infinite where no
+    background element has been seen yet) are replaced in place by their
+    lower envelope along each line of the given axis, with the given
+    sampling along that axis. Starting from zero at the background and
+    infinity elsewhere, a pass along every axis gives the squared
+    distances of distance_transform_edt. If given, the int32 features
+    (flat indices of the closest background elements) are updated
+    together with the distances. Parts of a larger array can be passed
+    one at a time, as long as they hold whole lines along the axis.
+    """
+    axis = _ni_support._check_axis(axis, squared.ndim)
+    _nd_image.euclidean_distance_lines(squared, features, axis,
+                                       float(sampling))
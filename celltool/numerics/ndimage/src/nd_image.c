@@ -95,6 +95,19 @@ NI_ObjectToIoArray(PyObject *object, PyArrayObject **array)
   return *array ? 1 : 0;
 }
 
+/* Convert an input/output array of any type, not necessarily contiguous */
+static int 
+NI_ObjectToOptionalIoArray(PyObject *object, PyArrayObject **array)
+{
+  if (object == Py_None) {
+    *array = NULL;
+    return 1;
+  } else {
+    *array = NA_IoArray(object, tAny, NUM_ALIGNED|NUM_NOTSWAPPED);
+    return *array ? 1 : 0;
+  }
+}
+
 /* Convert an Long sequence */
 static maybelong
 NI_ObjectToLongSequenceAndLength(PyObject *object, maybelong **sequence)
@@ -147,6 +160,25 @@ exit:
   return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_RecursiveGaussian1D(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *input = NULL, *output = NULL;
+  int axis, order, mode;
+  double sigma, cval;
+  
+  if (!PyArg_ParseTuple(args, "O&diiO&id", NI_ObjectToInputArray, &input,
+                  &sigma, &order, &axis, NI_ObjectToOutputArray, &output,
+                  &mode, &cval))
+    goto exit;
+  if (!NI_RecursiveGaussian1D(input, sigma, order, axis, output,
+                              (NI_ExtendMode)mode, cval))
+    goto exit;
+exit:
+  Py_XDECREF(input);
+  Py_XDECREF(output);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static PyObject *Py_Correlate(PyObject *obj, PyObject *args)
 {
   PyArrayObject *input = NULL, *output = NULL, *weights = NULL;
@@ -261,6 +293,32 @@ exit:
   return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_HistogramRankFilter(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *input = NULL, *output = NULL;
+  maybelong *shape = NULL, *origin = NULL;
+  int mode, rank;
+  long offset;
+  double cval;
+  
+  if (!PyArg_ParseTuple(args, "O&iO&O&idO&l", NI_ObjectToInputArray,
+                    &input, &rank, NI_ObjectToLongSequence, &shape,
+                    NI_ObjectToOutputArray, &output, &mode, &cval,
+                    NI_ObjectToLongSequence, &origin, &offset))
+    goto exit;
+  if (!NI_HistogramRankFilter(input, rank, shape, output,
+                              (NI_ExtendMode)mode, cval, origin, offset))
+    goto exit;
+exit:
+  Py_XDECREF(input);
+  Py_XDECREF(output);
+  if (shape)
+    free(shape);
+  if (origin)
+    free(origin);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static int Py_Filter1DFunc(double *iline, maybelong ilen,
                            double *oline, maybelong olen, void *data)
 {
@@ -620,6 +678,43 @@ exit:
   return PyErr_Occurred() ? NULL : Py_BuildValue("l", (long)max_label);
 }
 
+static PyObject *Py_LabelMerge(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *labels = NULL, *strct = NULL, *parents = NULL;
+  long offset1, offset2;
+
+  if (!PyArg_ParseTuple(args, "O&O&llO&", NI_ObjectToInputArray, &labels, 
+          NI_ObjectToInputArray, &strct, &offset1, &offset2,
+          NI_ObjectToIoArray, &parents))
+    goto exit;
+    
+  if (!NI_LabelMerge(labels, strct, offset1, offset2, parents))
+    goto exit;
+
+exit:
+  Py_XDECREF(labels);
+  Py_XDECREF(strct);
+  Py_XDECREF(parents);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
+static PyObject *Py_Relabel(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *labels = NULL, *map = NULL;
+
+  if (!PyArg_ParseTuple(args, "O&O&", NI_ObjectToIoArray, &labels, 
+          NI_ObjectToInputArray, &map))
+    goto exit;
+    
+  if (!NI_Relabel(labels, map))
+    goto exit;
+
+exit:
+  Py_XDECREF(labels);
+  Py_XDECREF(map);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static PyObject *Py_FindObjects(PyObject *obj, PyObject *args)
 {
   PyArrayObject *input = NULL;
@@ -1030,6 +1125,50 @@ static PyObject *Py_Statistics(PyObject *obj, PyObject *args)
 }
 
 
+static PyObject *Py_LabelStatistics(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *input = NULL, *labels = NULL, *records = NULL;
+  PyObject *indices_object;
+  maybelong min_label, max_label, *result_indices = NULL, n_results;
+  int features;
+  long offset;
+  
+  if (!PyArg_ParseTuple(args, "O&O&Oil", NI_ObjectToInputArray, &input, 
+          NI_ObjectToInputArray, &labels, &indices_object, &features,
+          &offset))
+    goto exit;
+  if (input->nd != labels->nd) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "input and labels shape are not equal");
+    goto exit;
+  }
+  if (indices_object == Py_None) {
+    PyErr_SetString(PyExc_RuntimeError, "no correct indices provided");
+    goto exit;
+  }
+  if (!_NI_GetIndices(indices_object, &result_indices, &min_label,
+                      &max_label, &n_results))
+    goto exit;
+  records = NA_NewArray(NULL, tFloat64, 2, (int)n_results,
+                        (int)NI_LabelStatisticsSize(input->nd));
+  if (!records)
+    goto exit;
+  if (!NI_LabelStatistics(input, labels, min_label, max_label,
+                          result_indices, n_results, features, offset,
+                          (double*)NA_OFFSETDATA(records)))
+    goto exit;
+ exit:
+  Py_XDECREF(input);
+  Py_XDECREF(labels);
+  if (result_indices)
+    free(result_indices);
+  if (PyErr_Occurred()) {
+    Py_XDECREF(records);
+    return NULL;
+  }
+  return (PyObject*)records;
+}
+
 static PyObject *Py_CenterOfMass(PyObject *obj, PyObject *args)
 {
   PyArrayObject *input = NULL, *labels = NULL;
@@ -1180,6 +1319,24 @@ exit:
   return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_EuclideanDistanceLines(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *distances = NULL, *features = NULL;
+  int axis;
+  double sampling;
+
+  if (!PyArg_ParseTuple(args, "O&O&id", NI_ObjectToIoArray, &distances,
+                        NI_ObjectToOptionalIoArray, &features, &axis,
+                        &sampling))
+    goto exit;
+  if (!NI_EuclideanDistanceLines(distances, features, axis, sampling))
+    goto exit;
+exit:
+  Py_XDECREF(distances);
+  Py_XDECREF(features);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static void _FreeCoordinateList(void* ptr) 
 {
   NI_FreeCoordinateList((NI_CoordinateList*)ptr);
@@ -1258,9 +1415,57 @@ exit:
   return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_BinaryErosionPacked(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *input = NULL, *output = NULL, *strct = NULL;
+  PyArrayObject *mask = NULL;
+  int border_value, invert, niter, changed = 0;
+  maybelong *origins = NULL;
+
+  if (!PyArg_ParseTuple(args, "O&O&O&O&iO&ii", NI_ObjectToInputArray,
+                        &input, NI_ObjectToInputArray, &strct,
+                        NI_ObjectToOptionalInputArray, &mask,
+                        NI_ObjectToOutputArray, &output, &border_value,
+                        NI_ObjectToLongSequence, &origins, &invert, &niter))
+    goto exit;
+  if (!NI_BinaryErosionPacked(input, strct, mask, output, border_value,
+                              origins, invert, niter, &changed))
+    goto exit;
+exit:
+  Py_XDECREF(input);
+  Py_XDECREF(strct);
+  Py_XDECREF(mask);
+  Py_XDECREF(output);
+  if (origins)
+    free(origins);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("i", changed);
+}
+
+static PyObject *Py_BinaryPropagationPacked(PyObject *obj, PyObject *args)
+{
+  PyArrayObject *input = NULL, *output = NULL, *mask = NULL;
+  int border_value, diagonal;
+
+  if (!PyArg_ParseTuple(args, "O&O&O&ii", NI_ObjectToInputArray, &input,
+                        NI_ObjectToOptionalInputArray, &mask,
+                        NI_ObjectToOutputArray, &output, &border_value,
+                        &diagonal))
+    goto exit;
+  if (!NI_BinaryPropagationPacked(input, mask, output, border_value,
+                                  diagonal))
+    goto exit;
+exit:
+  Py_XDECREF(input);
+  Py_XDECREF(mask);
+  Py_XDECREF(output);
+  return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static PyMethodDef methods[] = {
   {"correlate1d",           (PyCFunction)Py_Correlate1D,
    METH_VARARGS, ""},
+  {"recursive_gaussian1d",  (PyCFunction)Py_RecursiveGaussian1D,
+   METH_VARARGS, ""},
   {"correlate",             (PyCFunction)Py_Correlate,
    METH_VARARGS, ""},
   {"uniform_filter1d",      (PyCFunction)Py_UniformFilter1D,
@@ -1271,6 +1476,8 @@ static PyMethodDef methods[] = {
     METH_VARARGS, ""},
   {"rank_filter",           (PyCFunction)Py_RankFilter,
    METH_VARARGS, ""},
+  {"histogram_rank_filter", (PyCFunction)Py_HistogramRankFilter,
+   METH_VARARGS, ""},
   {"generic_filter",        (PyCFunction)Py_GenericFilter,
    METH_VARARGS, ""},
   {"generic_filter1d",      (PyCFunction)Py_GenericFilter1D,
@@ -1287,12 +1494,18 @@ static PyMethodDef methods[] = {
    METH_VARARGS, ""},
   {"label",                 (PyCFunction)Py_Label,
    METH_VARARGS, ""},
+  {"label_merge",           (PyCFunction)Py_LabelMerge,
+   METH_VARARGS, ""},
+  {"relabel",               (PyCFunction)Py_Relabel,
+   METH_VARARGS, ""},
   {"find_objects",          (PyCFunction)Py_FindObjects,
    METH_VARARGS, ""},
   {"watershed_ift",         (PyCFunction)Py_WatershedIFT,
    METH_VARARGS, ""},
   {"statistics",            (PyCFunction)Py_Statistics,
    METH_VARARGS, ""},
+  {"label_statistics",      (PyCFunction)Py_LabelStatistics,
+   METH_VARARGS, ""},
   {"center_of_mass",        (PyCFunction)Py_CenterOfMass,
    METH_VARARGS, ""},
   {"histogram",             (PyCFunction)Py_Histogram,
@@ -1303,10 +1516,16 @@ static PyMethodDef methods[] = {
    METH_VARARGS, ""},
   {"euclidean_feature_transform",
    (PyCFunction)Py_EuclideanFeatureTransform, METH_VARARGS, ""},
+  {"euclidean_distance_lines",
+   (PyCFunction)Py_EuclideanDistanceLines, METH_VARARGS, ""},
   {"binary_erosion",        (PyCFunction)Py_BinaryErosion,
    METH_VARARGS, ""},
   {"binary_erosion2",       (PyCFunction)Py_BinaryErosion2,
    METH_VARARGS, ""},
+  {"binary_erosion_packed", (PyCFunction)Py_BinaryErosionPacked,
+   METH_VARARGS, ""},
+  {"binary_propagation_packed", (PyCFunction)Py_BinaryPropagationPacked,
+   METH_VARARGS, ""},
   {NULL, NULL, 0, NULL}
 };
 
@@ -129,6 +129,218 @@ exit:
   return PyErr_Occurred() ? 0 : 1;
 }
 
+/* The recursive Gaussian filter is the fourth-order approximation of
+   Deriche (INRIA research report 1893, 1993), with the coefficients and
+   normalizations of the Insight Toolkit. Each of the Gaussian and its
+   first and second derivatives is fit over x >= 0 by
+   (a1 cos(w1 x) + b1 sin(w1 x)) exp(l1 x) +
+   (a2 cos(w2 x) + b2 sin(w2 x)) exp(l2 x), with x in units of sigma: */
+#define RG_W1 0.6681
+#define RG_L1 -1.3932
+#define RG_W2 2.0787
+#define RG_L2 -1.3732
+static const double rg_a1[3] = {1.3530, -0.6724, -1.3563};
+static const double rg_b1[3] = {1.8151, -3.4327, 5.2318};
+static const double rg_a2[3] = {-0.3531, 0.6724, 0.3446};
+static const double rg_b2[3] = {0.0902, 0.6100, -2.2355};
+
+/* Numerator coefficients of the causal filter fitting the given order, and
+   their sum and first and second moments: */
+static void 
+recursive_gaussian_numerator(double sigma, int order, double *n,
+                             double *sn, double *dn, double *en)
+{
+  double s1 = sin(RG_W1 / sigma), s2 = sin(RG_W2 / sigma);
+  double c1 = cos(RG_W1 / sigma), c2 = cos(RG_W2 / sigma);
+  double e1 = exp(RG_L1 / sigma), e2 = exp(RG_L2 / sigma);
+  double a1 = rg_a1[order], b1 = rg_b1[order];
+  double a2 = rg_a2[order], b2 = rg_b2[order];
+
+  n[0] = a1 + a2;
+  n[1] = e2 * (b2 * s2 - (a2 + 2.0 * a1) * c2) +
+         e1 * (b1 * s1 - (a1 + 2.0 * a2) * c1);
+  n[2] = 2.0 * e1 * e2 * ((a1 + a2) * c2 * c1 - b1 * c2 * s1 -
+         b2 * c1 * s2) + a2 * e1 * e1 + a1 * e2 * e2;
+  n[3] = e2 * e1 * e1 * (b2 * s2 - a2 * c2) +
+         e1 * e2 * e2 * (b1 * s1 - a1 * c1);
+  *sn = n[0] + n[1] + n[2] + n[3];
+  *dn = n[1] + 2.0 * n[2] + 3.0 * n[3];
+  *en = n[1] + 4.0 * n[2] + 9.0 * n[3];
+}
+
+/* Calculate the coefficients of the causal recursion
+   y[i] = n[0] x[i] + ... + n[3] x[i-3] - d[0] y[i-1] - ... - d[3] y[i-4]
+   and of the anti-causal recursion
+   z[i] = m[0] x[i+1] + ... + m[3] x[i+4] - d[0] z[i+1] - ... - d[3] z[i+4]
+   whose sum y + z approximates convolution with the Gaussian (order 0) or
+   its first or second derivative. */
+static void 
+recursive_gaussian_coefficients(double sigma, int order, double *n,
+                                double *m, double *d)
+{
+  double c1 = cos(RG_W1 / sigma), c2 = cos(RG_W2 / sigma);
+  double e1 = exp(RG_L1 / sigma), e2 = exp(RG_L2 / sigma);
+  double sd, dd, ed, sn, dn, en, alpha;
+  int ii;
+
+  d[3] = e1 * e1 * e2 * e2;
+  d[2] = -2.0 * c1 * e1 * e2 * e2 - 2.0 * c2 * e2 * e1 * e1;
+  d[1] = 4.0 * c2 * c1 * e1 * e2 + e1 * e1 + e2 * e2;
+  d[0] = -2.0 * (e2 * c2 + e1 * c1);
+  sd = 1.0 + d[0] + d[1] + d[2] + d[3];
+  dd = d[0] + 2.0 * d[1] + 3.0 * d[2] + 4.0 * d[3];
+  ed = d[0] + 4.0 * d[1] + 9.0 * d[2] + 16.0 * d[3];
+  /* the numerators are normalized so that the combined filter has unit
+     sum (order 0), or gives unit first or second derivatives of x and x^2
+     / 2 respectively: */
+  switch (order) {
+  case 1:
+    recursive_gaussian_numerator(sigma, 1, n, &sn, &dn, &en);
+    alpha = 2.0 * (sn * dd - dn * sd) / (sd * sd);
+    break;
+  case 2:
+    {
+      double n0[4], sn0, dn0, en0, beta;
+      recursive_gaussian_numerator(sigma, 0, n0, &sn0, &dn0, &en0);
+      recursive_gaussian_numerator(sigma, 2, n, &sn, &dn, &en);
+      beta = -(2.0 * sn - sd * n[0]) / (2.0 * sn0 - sd * n0[0]);
+      for(ii = 0; ii < 4; ii++)
+        n[ii] += beta * n0[ii];
+      sn += beta * sn0;
+      dn += beta * dn0;
+      en += beta * en0;
+      alpha = (en * sd * sd - ed * sn * sd - 2.0 * dn * dd * sd +
+               2.0 * dd * dd * sn) / (sd * sd * sd);
+    }
+    break;
+  default:
+    recursive_gaussian_numerator(sigma, 0, n, &sn, &dn, &en);
+    alpha = 2.0 * sn / sd - n[0];
+    break;
+  }
+  for(ii = 0; ii < 4; ii++)
+    n[ii] /= alpha;
+  /* the anti-causal filter mirrors the causal one, with a change of sign
+     for the (antisymmetric) first derivative: */
+  for(ii = 0; ii < 3; ii++)
+    m[ii] = n[ii + 1] - d[ii] * n[0];
+  m[3] = -d[3] * n[0];
+  if (order == 1)
+    for(ii = 0; ii < 4; ii++)
+      m[ii] = -m[ii];
+}
+
+/* number of lines filtered at once by the recursive Gaussian filter: */
+#define RG_LINES 8
+
+int NI_RecursiveGaussian1D(PyArrayObject *input, double sigma, int order,
+                           int axis, PyArrayObject *output,
+                           NI_ExtendMode mode, double cval)
+{
+  int more, bb, nb, jj;
+  maybelong ii, ll, lines, length, margin, size, stride;
+  double *ibuffer = NULL, *obuffer = NULL, *work = NULL, *x, *y, *z;
+  double n[4], m[4], d[4], sn = 0.0, sm = 0.0, sd = 1.0;
+  NI_LineBuffer iline_buffer, oline_buffer;
+
+  if (order < 0 || order > 2) {
+    PyErr_SetString(PyExc_RuntimeError, "order not supported");
+    goto exit;
+  }
+  recursive_gaussian_coefficients(sigma, order, n, m, d);
+  for(jj = 0; jj < 4; jj++) {
+    sn += n[jj];
+    sm += m[jj];
+    sd += d[jj];
+  }
+  /* the recursions start from the steady state for the values at the ends
+     of the lines as extended by the boundary mode. The error this makes in
+     the lines themselves decays as exp(-1.37 * distance / sigma), so the
+     lines are extended by 8 sigma: */
+  margin = (maybelong)ceil(8.0 * sigma) + 4;
+  length = input->nd > 0 ? input->dimensions[axis] : 1;
+  size = length + 2 * margin;
+  lines = -1;
+  if (!NI_AllocateLineBuffer(input, axis, margin, margin, &lines,
+                             BUFFER_SIZE, &ibuffer))
+    goto exit;
+  if (!NI_AllocateLineBuffer(output, axis, 0, 0, &lines, BUFFER_SIZE,
+                             &obuffer))
+    goto exit;
+  if (!NI_InitLineBuffer(input, axis, margin, margin, lines, ibuffer,
+                         mode, cval, &iline_buffer))
+    goto exit;
+  if (!NI_InitLineBuffer(output, axis, 0, 0, lines, obuffer, mode, 0.0,
+                         &oline_buffer))
+    goto exit;
+  /* blocks of lines are filtered interleaved, element ll of line bb at
+     x[(ll + 4) * RG_LINES + bb], so that each step of the recursions is
+     taken for the whole block at once (and can be vectorized). Four
+     elements at each end hold the initial conditions. The input, causal
+     and anti-causal lines are kept in x, y and z: */
+  stride = (size + 8) * RG_LINES;
+  work = (double*)malloc(3 * stride * sizeof(double));
+  if (!work) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+  x = work;
+  y = work + stride;
+  z = work + 2 * stride;
+  do {
+    if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more))
+      goto exit;
+    for(ii = 0; ii < lines; ii += nb) {
+      double *xl, *yl, *zl;
+      nb = lines - ii < RG_LINES ? (int)(lines - ii) : RG_LINES;
+      for(bb = 0; bb < RG_LINES; bb++) {
+        double *iline = NI_GET_LINE(iline_buffer, ii + (bb < nb ? bb : 0));
+        for(ll = 0; ll < size; ll++)
+          x[(ll + 4) * RG_LINES + bb] = iline[ll];
+      }
+      for(ll = 0; ll < 4 * RG_LINES; ll++) {
+        bb = (int)(ll % RG_LINES);
+        x[ll] = x[4 * RG_LINES + bb];
+        y[ll] = sn / sd * x[ll];
+        x[stride - 4 * RG_LINES + ll] = x[stride - 5 * RG_LINES + bb];
+        z[stride - 4 * RG_LINES + ll] = sm / sd * x[stride - 5 * RG_LINES + bb];
+      }
+      for(ll = 4; ll < size + 4; ll++) {
+        xl = x + ll * RG_LINES;
+        yl = y + ll * RG_LINES;
+        for(bb = 0; bb < RG_LINES; bb++)
+          yl[bb] = n[0] * xl[bb] + n[1] * xl[bb - RG_LINES] +
+            n[2] * xl[bb - 2 * RG_LINES] + n[3] * xl[bb - 3 * RG_LINES] -
+            d[0] * yl[bb - RG_LINES] - d[1] * yl[bb - 2 * RG_LINES] -
+            d[2] * yl[bb - 3 * RG_LINES] - d[3] * yl[bb - 4 * RG_LINES];
+      }
+      for(ll = size + 3; ll >= 4; ll--) {
+        xl = x + ll * RG_LINES;
+        zl = z + ll * RG_LINES;
+        for(bb = 0; bb < RG_LINES; bb++)
+          zl[bb] = m[0] * xl[bb + RG_LINES] + m[1] * xl[bb + 2 * RG_LINES] +
+            m[2] * xl[bb + 3 * RG_LINES] + m[3] * xl[bb + 4 * RG_LINES] -
+            d[0] * zl[bb + RG_LINES] - d[1] * zl[bb + 2 * RG_LINES] -
+            d[2] * zl[bb + 3 * RG_LINES] - d[3] * zl[bb + 4 * RG_LINES];
+      }
+      for(bb = 0; bb < nb; bb++) {
+        double *oline = NI_GET_LINE(oline_buffer, ii + bb);
+        yl = y + (margin + 4) * RG_LINES + bb;
+        zl = z + (margin + 4) * RG_LINES + bb;
+        for(ll = 0; ll < length; ll++)
+          oline[ll] = yl[ll * RG_LINES] + zl[ll * RG_LINES];
+      }
+    }
+    if (!NI_LineBufferToArray(&oline_buffer))
+      goto exit;
+  } while(more);
+exit:
+  if (ibuffer) free(ibuffer);
+  if (obuffer) free(obuffer);
+  if (work) free(work);
+  return PyErr_Occurred() ? 0 : 1;
+}
+
 #define CASE_CORRELATE_POINT(_pi, _weights, _offsets, _filter_size, \
                              _cvalue, _type, _res, _mv)             \
 case t ## _type:                                                    \
@@ -335,14 +547,54 @@ NI_UniformFilter1D(PyArrayObject *input, long filter_size,
   return PyErr_Occurred() ? 0 : 1;
 }
 
+/* number of lines filtered at once by the van Herk/Gil-Werman filter: */
+#define MM_LINES 8
+
+/* The running minimum or maximum over windows of size k of n interleaved
+   lines x, following van Herk (Pattern Recognition Letters 1992; 13:
+   517-521) and Gil and Werman (IEEE PAMI 1993; 15: 504-507). The lines are
+   cut into blocks of k elements; h holds the minima or maxima from each
+   element to the end of its block, and x is overwritten with those from
+   the start of its block. Each window then spans the end of one block and
+   the start of the next, so that its result is the lesser or greater of
+   h at its start and x at its end, whatever the size of the window. */
+#define VAN_HERK_LINES(_x, _h, _n, _k, _better)                            \
+{                                                                         \
+  maybelong _ll, _bb;                                                     \
+  for(_ll = _n - 1; _ll >= 0; _ll--) {                                    \
+    double *_hl = _h + _ll * MM_LINES, *_xl = _x + _ll * MM_LINES;        \
+    if (_ll == _n - 1 || (_ll + 1) % _k == 0) {                           \
+      for(_bb = 0; _bb < MM_LINES; _bb++)                                 \
+        _hl[_bb] = _xl[_bb];                                              \
+    } else {                                                              \
+      for(_bb = 0; _bb < MM_LINES; _bb++)                                 \
+        _hl[_bb] = _xl[_bb] _better _hl[_bb + MM_LINES] ?                 \
+                   _xl[_bb] : _hl[_bb + MM_LINES];                        \
+    }                                                                     \
+  }                                                                       \
+  for(_ll = 1; _ll < _n; _ll++) {                                         \
+    double *_xl = _x + _ll * MM_LINES;                                    \
+    if (_ll % _k != 0)                                                    \
+      for(_bb = 0; _bb < MM_LINES; _bb++)                                 \
+        _xl[_bb] = _xl[_bb] _better _xl[_bb - MM_LINES] ?                 \
+                   _xl[_bb] : _xl[_bb - MM_LINES];                        \
+  }                                                                       \
+  for(_ll = 0; _ll + _k - 1 < _n; _ll++) {                                \
+    double *_hl = _h + _ll * MM_LINES;                                    \
+    double *_xl = _x + (_ll + _k - 1) * MM_LINES;                         \
+    for(_bb = 0; _bb < MM_LINES; _bb++)                                   \
+      _hl[_bb] = _hl[_bb] _better _xl[_bb] ? _hl[_bb] : _xl[_bb];         \
+  }                                                                       \
+}
+
 int
 NI_MinOrMaxFilter1D(PyArrayObject *input, long filter_size,
                     int axis, PyArrayObject *output, NI_ExtendMode mode,
                     double cval, long origin, int minimum)
 {
-  maybelong lines, kk, jj, ll, length, size1, size2;
-  int more;
-  double *ibuffer = NULL, *obuffer = NULL;
+  maybelong lines, kk, jj, ll, length, size1, size2, nn;
+  int more, bb, nb;
+  double *ibuffer = NULL, *obuffer = NULL, *work = NULL;
   NI_LineBuffer iline_buffer, oline_buffer;
 
   size1 = filter_size / 2;
@@ -362,31 +614,63 @@ NI_MinOrMaxFilter1D(PyArrayObject *input, long filter_size,
                          &oline_buffer))
     goto exit;
   length = input->nd > 0 ? input->dimensions[axis] : 1;
+  /* windows of more than three elements are filtered in interleaved
+     blocks of lines by the van Herk/Gil-Werman algorithm, which takes
+     three comparisons per element: */
+  nn = length + filter_size - 1;
+  if (filter_size > 3) {
+    work = (double*)malloc(2 * nn * MM_LINES * sizeof(double));
+    if (!work) {
+      PyErr_NoMemory();
+      goto exit;
+    }
+  }
   
   /* iterate over all the array lines: */
   do {
     /* copy lines from array to buffer: */
     if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more))
       goto exit;
-    /* iterate over the lines in the buffers: */
-    for(kk = 0; kk < lines; kk++) {
-      /* get lines: */
-      double *iline = NI_GET_LINE(iline_buffer, kk) + size1;
-      double *oline = NI_GET_LINE(oline_buffer, kk);
-      for(ll = 0; ll < length; ll++) {
-      /* find minimum or maximum filter: */
-        double val = iline[ll - size1];
-        for(jj = -size1 + 1; jj <= size2; jj++) {
-          double tmp = iline[ll + jj];
-          if (minimum) { 
-            if (tmp < val)
-              val = tmp;
-          } else {
-            if (tmp > val)
-              val = tmp;
+    if (work) {
+      double *hh = work + nn * MM_LINES;
+      for(kk = 0; kk < lines; kk += nb) {
+        nb = lines - kk < MM_LINES ? (int)(lines - kk) : MM_LINES;
+        for(bb = 0; bb < MM_LINES; bb++) {
+          double *iline = NI_GET_LINE(iline_buffer, kk + (bb < nb ? bb : 0));
+          for(ll = 0; ll < nn; ll++)
+            work[ll * MM_LINES + bb] = iline[ll];
+        }
+        if (minimum)
+          VAN_HERK_LINES(work, hh, nn, filter_size, <)
+        else
+          VAN_HERK_LINES(work, hh, nn, filter_size, >)
+        for(bb = 0; bb < nb; bb++) {
+          double *oline = NI_GET_LINE(oline_buffer, kk + bb);
+          for(ll = 0; ll < length; ll++)
+            oline[ll] = hh[ll * MM_LINES + bb];
+        }
+      }
+    } else {
+      /* iterate over the lines in the buffers: */
+      for(kk = 0; kk < lines; kk++) {
+        /* get lines: */
+        double *iline = NI_GET_LINE(iline_buffer, kk) + size1;
+        double *oline = NI_GET_LINE(oline_buffer, kk);
+        for(ll = 0; ll < length; ll++) {
+        /* find minimum or maximum filter: */
+          double val = iline[ll - size1];
+          for(jj = -size1 + 1; jj <= size2; jj++) {
+            double tmp = iline[ll + jj];
+            if (minimum) { 
+              if (tmp < val)
+                val = tmp;
+            } else {
+              if (tmp > val)
+                val = tmp;
+            }
           }
+          oline[ll] = val;
         }
-        oline[ll] = val;
       }
     }
     /* copy lines from buffer to array: */
@@ -397,6 +681,7 @@ NI_MinOrMaxFilter1D(PyArrayObject *input, long filter_size,
  exit:
   if (ibuffer) free(ibuffer);
   if (obuffer) free(obuffer);
+  if (work) free(work);
   return PyErr_Occurred() ? 0 : 1;
 }
 
@@ -703,6 +988,277 @@ exit:
   return PyErr_Occurred() ? 0 : 1;
 }
 
+/* The rank filters below are for 2D UInt8 and UInt16 images and
+   rectangular footprints. They keep a histogram of the footprint as it
+   slides along each row, rather than selecting from the whole footprint at
+   every point. */
+
+/* UInt8 images use the algorithm of Perreault and Hebert (IEEE Trans.
+   Image Proc. 2007; 16: 2389-2394), which keeps a histogram of each image
+   column over the height of the footprint. The histogram of the footprint
+   is then moved one point along a row by adding one column histogram and
+   subtracting another, whatever the size of the footprint. The histograms
+   have two levels, of 16 coarse bins of 16 fine bins each, and the fine
+   bins of the footprint histogram are only brought up to date for the
+   coarse bin holding the rank. pad holds the image rows extended by the
+   footprint, of wc = cols + fw - 1 elements each: */
+static int 
+rank_filter_uint8(unsigned short *pad, maybelong rows, maybelong cols,
+                  maybelong fh, maybelong fw, int rank, char *po,
+                  maybelong ostride0, maybelong ostride1)
+{
+  maybelong wc = cols + fw - 1, xx, yy, jj, pp, lu[16];
+  int *hc, *hf, kc[16], kf[256], cc, ff, ss;
+  unsigned short *pr;
+
+  hc = (int*)calloc(wc * (16 + 256), sizeof(int));
+  if (!hc)
+    return 0;
+  hf = hc + wc * 16;
+  for(yy = 0; yy < rows; yy++) {
+    /* move the column histograms down to the rows of this output row: */
+    if (yy == 0) {
+      for(pr = pad; pr < pad + (fh - 1) * wc; pr++) {
+        jj = (pr - pad) % wc;
+        ++hc[jj * 16 + (*pr >> 4)];
+        ++hf[jj * 256 + *pr];
+      }
+    } else {
+      pr = pad + (yy - 1) * wc;
+      for(jj = 0; jj < wc; jj++) {
+        --hc[jj * 16 + (pr[jj] >> 4)];
+        --hf[jj * 256 + pr[jj]];
+      }
+    }
+    pr = pad + (yy + fh - 1) * wc;
+    for(jj = 0; jj < wc; jj++) {
+      ++hc[jj * 16 + (pr[jj] >> 4)];
+      ++hf[jj * 256 + pr[jj]];
+    }
+    for(cc = 0; cc < 16; cc++) {
+      kc[cc] = 0;
+      lu[cc] = -1;
+    }
+    for(jj = 0; jj < fw; jj++)
+      for(cc = 0; cc < 16; cc++)
+        kc[cc] += hc[jj * 16 + cc];
+    for(xx = 0; xx < cols; xx++) {
+      int *fine;
+      if (xx > 0) {
+        int *add = hc + (xx + fw - 1) * 16, *sub = hc + (xx - 1) * 16;
+        for(cc = 0; cc < 16; cc++)
+          kc[cc] += add[cc] - sub[cc];
+      }
+      ss = 0;
+      for(cc = 0; ss + kc[cc] <= rank; cc++)
+        ss += kc[cc];
+      /* update the fine bins of the coarse bin, from the column histograms
+         that entered and left the footprint since they were last updated,
+         or afresh if that is cheaper: */
+      fine = kf + cc * 16;
+      if (lu[cc] < 0 || xx - lu[cc] > fw) {
+        for(ff = 0; ff < 16; ff++)
+          fine[ff] = 0;
+        for(jj = xx; jj < xx + fw; jj++) {
+          int *add = hf + jj * 256 + cc * 16;
+          for(ff = 0; ff < 16; ff++)
+            fine[ff] += add[ff];
+        }
+      } else {
+        for(pp = lu[cc] + 1; pp <= xx; pp++) {
+          int *add = hf + (pp + fw - 1) * 256 + cc * 16;
+          int *sub = hf + (pp - 1) * 256 + cc * 16;
+          for(ff = 0; ff < 16; ff++)
+            fine[ff] += add[ff] - sub[ff];
+        }
+      }
+      lu[cc] = xx;
+      for(ff = 0; ss + fine[ff] <= rank; ff++)
+        ss += fine[ff];
+      *(UInt8*)(po + yy * ostride0 + xx * ostride1) = (UInt8)(cc * 16 + ff);
+    }
+  }
+  free(hc);
+  return 1;
+}
+
+/* UInt16 images use the algorithm of Huang, Yang and Tang (IEEE Trans.
+   Acoust., Speech, Signal Proc. 1979; 27: 13-18): the footprint histogram
+   is moved along a row by adding and subtracting the elements of a column
+   of the footprint, which takes time proportional to its height only.
+   Column histograms as above would need 256 kB per image column. The
+   histogram has 256 coarse bins of 256 fine bins, and the coarse bin of
+   the rank is followed as the footprint moves, so that finding the rank
+   takes a few steps over the coarse bins and at most 256 over the fine: */
+static int 
+rank_filter_uint16(unsigned short *pad, maybelong rows, maybelong cols,
+                   maybelong fh, maybelong fw, int rank, char *po,
+                   maybelong ostride0, maybelong ostride1)
+{
+  maybelong wc = cols + fw - 1, xx, yy, jj, kk;
+  int *kc, *kf, cc, ff, lt;
+  unsigned short *pr;
+
+  kc = (int*)calloc(256 + 65536, sizeof(int));
+  if (!kc)
+    return 0;
+  kf = kc + 256;
+  for(yy = 0; yy < rows; yy++) {
+    /* the histogram starts from the first footprint of the row, and lt
+       counts the elements in coarse bins below cc: */
+    cc = 0;
+    lt = 0;
+    for(jj = 0; jj < fh; jj++) {
+      pr = pad + (yy + jj) * wc;
+      for(kk = 0; kk < fw; kk++) {
+        ++kc[pr[kk] >> 8];
+        ++kf[pr[kk]];
+      }
+    }
+    for(xx = 0; xx < cols; xx++) {
+      if (xx > 0) {
+        pr = pad + yy * wc + xx - 1;
+        for(jj = 0; jj < fh; jj++, pr += wc) {
+          unsigned short sub = pr[0], add = pr[fw];
+          --kc[sub >> 8];
+          --kf[sub];
+          if ((sub >> 8) < cc)
+            --lt;
+          ++kc[add >> 8];
+          ++kf[add];
+          if ((add >> 8) < cc)
+            ++lt;
+        }
+      }
+      while (lt > rank)
+        lt -= kc[--cc];
+      while (lt + kc[cc] <= rank)
+        lt += kc[cc++];
+      {
+        int ss = lt, *fine = kf + cc * 256;
+        for(ff = 0; ss + fine[ff] <= rank; ff++)
+          ss += fine[ff];
+      }
+      *(UInt16*)(po + yy * ostride0 + xx * ostride1) = (UInt16)(cc * 256 + ff);
+    }
+    /* empty the histogram of the last footprint of the row: */
+    for(jj = 0; jj < fh; jj++) {
+      pr = pad + (yy + jj) * wc + cols - 1;
+      for(kk = 0; kk < fw; kk++) {
+        --kc[pr[kk] >> 8];
+        --kf[pr[kk]];
+      }
+    }
+  }
+  free(kc);
+  return 1;
+}
+
+/* The indices of the elements of a line of the given length when extended
+   by before and after elements according to the mode, or -1 for the
+   constant value. */
+static maybelong* 
+extended_line_indices(maybelong length, maybelong before, maybelong after,
+                      NI_ExtendMode mode)
+{
+  maybelong ii, size = length + before + after, *indices = NULL;
+  double *line = (double*)malloc(size * sizeof(double));
+
+  if (!line)
+    goto exit;
+  for(ii = 0; ii < length; ii++)
+    line[before + ii] = (double)ii;
+  if (!NI_ExtendLine(line, length, before, after, mode, -1.0))
+    goto exit;
+  indices = (maybelong*)malloc(size * sizeof(maybelong));
+  if (!indices)
+    goto exit;
+  for(ii = 0; ii < size; ii++)
+    indices[ii] = (maybelong)line[ii];
+exit:
+  if (line) free(line);
+  if (!indices && !PyErr_Occurred())
+    PyErr_NoMemory();
+  return indices;
+}
+
+/* Rank filter of a 2D UInt8 or UInt16 image with a rectangular footprint
+   of the given shape. The output may be a block of the rows of the full
+   output, starting at row offset, so that blocks can be filtered on
+   separate threads; the interpreter lock is released while filtering. The
+   constant value must be representable in the image type. */
+int NI_HistogramRankFilter(PyArrayObject* input, int rank,
+                           maybelong *shape, PyArrayObject* output,
+                           NI_ExtendMode mode, double cvalue,
+                           maybelong *origins, maybelong offset)
+{
+  maybelong rows, cols, wc, fh = shape[0], fw = shape[1], b0, b1, yy, xx;
+  maybelong *row_indices = NULL, *col_indices = NULL;
+  unsigned short *pad = NULL, cv = (unsigned short)cvalue;
+  char *pi = NA_OFFSETDATA(input);
+  int type = input->descr->type_num, ok = 1;
+  NPY_BEGIN_THREADS_DEF
+
+  if (input->nd != 2 || output->nd != 2 ||
+      output->descr->type_num != type ||
+      (type != tUInt8 && type != tUInt16)) {
+    PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+    goto exit;
+  }
+  rows = output->dimensions[0];
+  cols = output->dimensions[1];
+  b0 = fh / 2 + origins[0];
+  b1 = fw / 2 + origins[1];
+  if (b0 < 0 || b0 >= fh || b1 < 0 || b1 >= fw) {
+    PyErr_SetString(PyExc_RuntimeError, "invalid origin");
+    goto exit;
+  }
+  row_indices = extended_line_indices(input->dimensions[0], b0, fh - b0 - 1,
+                                      mode);
+  col_indices = extended_line_indices(input->dimensions[1], b1, fw - b1 - 1,
+                                      mode);
+  if (!row_indices || !col_indices)
+    goto exit;
+  NPY_BEGIN_THREADS
+  /* copy the rows of the image under the footprints of the output: */
+  wc = cols + fw - 1;
+  pad = (unsigned short*)malloc((rows + fh - 1) * wc *
+                                sizeof(unsigned short));
+  if (!pad) {
+    ok = 0;
+    goto exit;
+  }
+  for(yy = 0; yy < rows + fh - 1; yy++) {
+    maybelong ri = row_indices[offset + yy];
+    unsigned short *pr = pad + yy * wc;
+    for(xx = 0; xx < wc; xx++) {
+      maybelong ci = col_indices[xx];
+      if (ri < 0 || ci < 0) {
+        pr[xx] = cv;
+      } else {
+        char *p = pi + ri * input->strides[0] + ci * input->strides[1];
+        pr[xx] = type == tUInt8 ? *(UInt8*)p : *(UInt16*)p;
+      }
+    }
+  }
+  if (type == tUInt8)
+    ok = rank_filter_uint8(pad, rows, cols, fh, fw, rank,
+                           NA_OFFSETDATA(output), output->strides[0],
+                           output->strides[1]);
+  else
+    ok = rank_filter_uint16(pad, rows, cols, fh, fw, rank,
+                            NA_OFFSETDATA(output), output->strides[0],
+                            output->strides[1]);
+exit:
+  NPY_END_THREADS;
+  if (!ok)
+    PyErr_NoMemory();
+  if (pad) free(pad);
+  if (row_indices) free(row_indices);
+  if (col_indices) free(col_indices);
+  return PyErr_Occurred() ? 0 : 1;
+}
+
 int NI_GenericFilter1D(PyArrayObject *input,
         int (*function)(double*, maybelong, double*, maybelong, void*),
         void* data, long filter_size, int axis, PyArrayObject *output, 
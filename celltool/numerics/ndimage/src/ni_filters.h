@@ -34,6 +34,8 @@
 
 int NI_Correlate1D(PyArrayObject*, PyArrayObject*, int, PyArrayObject*,
                    NI_ExtendMode, double, maybelong);
+int NI_RecursiveGaussian1D(PyArrayObject*, double, int, int, PyArrayObject*,
+                           NI_ExtendMode, double);
 int NI_Correlate(PyArrayObject*, PyArrayObject*, PyArrayObject*,
                  NI_ExtendMode, double, maybelong*);
 int NI_UniformFilter1D(PyArrayObject*, long, int, PyArrayObject*,
@@ -45,6 +47,8 @@ int NI_MinOrMaxFilter(PyArrayObject*, PyArrayObject*, PyArrayObject*,
                       int);
 int NI_RankFilter(PyArrayObject*, int, PyArrayObject*, PyArrayObject*,
                   NI_ExtendMode, double, maybelong*);
+int NI_HistogramRankFilter(PyArrayObject*, int, maybelong*, PyArrayObject*,
+                           NI_ExtendMode, double, maybelong*, maybelong);
 int NI_GenericFilter1D(PyArrayObject*, int (*)(double*, maybelong, 
                        double*, maybelong, void*), void*, long, int,
                        PyArrayObject*, NI_ExtendMode, double, long);
@@ -198,6 +198,156 @@ map_coordinate(double in, maybelong len, int mode)
 #define BUFFER_SIZE 256000
 #define TOLERANCE 1e-15
 
+/* test if two arrays are views of the same data with the same layout: */
+static int 
+same_array(PyArrayObject *array1, PyArrayObject *array2)
+{
+  int ii;
+
+  if (NA_OFFSETDATA(array1) != NA_OFFSETDATA(array2) ||
+      array1->nd != array2->nd ||
+      array1->descr->type_num != array2->descr->type_num)
+    return 0;
+  for(ii = 0; ii < array1->nd; ii++)
+    if (array1->dimensions[ii] != array2->dimensions[ii] ||
+        array1->strides[ii] != array2->strides[ii])
+      return 0;
+  return 1;
+}
+
+/* number of lines filtered at once by the single-precision spline filter: */
+#define SPLINE_LINES 16
+
+/* Spline filter a block of SPLINE_LINES lines of length len > 1, stored
+   interleaved so that element ll of line bb is buffer[ll * SPLINE_LINES +
+   bb]. This is the same calculation as in NI_SplineFilter1D, but each step
+   of the recursions is taken for all lines of the block at once, in loops
+   that the compiler can vectorize. */
+static void 
+spline_filter_lines(float *buffer, maybelong len, int npoles, double *pole,
+                    double weight)
+{
+  int hh, bb;
+  maybelong ll;
+  float sum[SPLINE_LINES], *ln, *lp;
+
+  for(ll = 0; ll < len * SPLINE_LINES; ll++)
+    buffer[ll] *= (float)weight;
+  for(hh = 0; hh < npoles; hh++) {
+    double p = pole[hh];
+    int max = (int)ceil(log(TOLERANCE) / log(fabs(p)));
+    if (max < len) {
+      double zn = p;
+      for(bb = 0; bb < SPLINE_LINES; bb++)
+        sum[bb] = buffer[bb];
+      for(ll = 1; ll < max; ll++) {
+        float z = (float)zn;
+        ln = buffer + ll * SPLINE_LINES;
+        for(bb = 0; bb < SPLINE_LINES; bb++)
+          sum[bb] += z * ln[bb];
+        zn *= p;
+      }
+      for(bb = 0; bb < SPLINE_LINES; bb++)
+        buffer[bb] = sum[bb];
+    } else {
+      double zn = p;
+      double iz = 1.0 / p;
+      double z2n = pow(p, (double)(len - 1));
+      float z = (float)z2n, norm;
+      ln = buffer + (len - 1) * SPLINE_LINES;
+      for(bb = 0; bb < SPLINE_LINES; bb++)
+        sum[bb] = buffer[bb] + z * ln[bb];
+      z2n *= z2n * iz;
+      for(ll = 1; ll <= len - 2; ll++) {
+        z = (float)(zn + z2n);
+        ln = buffer + ll * SPLINE_LINES;
+        for(bb = 0; bb < SPLINE_LINES; bb++)
+          sum[bb] += z * ln[bb];
+        zn *= p;
+        z2n *= iz;
+      }
+      norm = (float)(1.0 / (1.0 - zn * zn));
+      for(bb = 0; bb < SPLINE_LINES; bb++)
+        buffer[bb] = sum[bb] * norm;
+    }
+    {
+      float fp = (float)p, last = (float)(p / (p * p - 1.0));
+      for(ll = 1; ll < len; ll++) {
+        ln = buffer + ll * SPLINE_LINES;
+        lp = ln - SPLINE_LINES;
+        for(bb = 0; bb < SPLINE_LINES; bb++)
+          ln[bb] += fp * lp[bb];
+      }
+      ln = buffer + (len - 1) * SPLINE_LINES;
+      lp = ln - SPLINE_LINES;
+      for(bb = 0; bb < SPLINE_LINES; bb++)
+        ln[bb] = last * (ln[bb] + fp * lp[bb]);
+      for(ll = len - 2; ll >= 0; ll--) {
+        ln = buffer + ll * SPLINE_LINES;
+        lp = ln + SPLINE_LINES;
+        for(bb = 0; bb < SPLINE_LINES; bb++)
+          ln[bb] = fp * (lp[bb] - ln[bb]);
+      }
+    }
+  }
+}
+
+/* Spline filter a single-precision array in place along the given axis,
+   copying blocks of SPLINE_LINES lines at a time to an interleaved buffer
+   to be filtered together. Consecutive lines are adjacent in memory unless
+   the axis is the last one, so the copies mostly read whole cache lines. */
+static int 
+spline_filter_float32(PyArrayObject *array, int axis, int npoles,
+                         double *pole, double weight)
+{
+  maybelong kk, ll, lines, len = array->dimensions[axis];
+  maybelong stride = array->strides[axis];
+  int bb, nb, qq;
+  char *pa = NA_OFFSETDATA(array), *starts[SPLINE_LINES];
+  float *buffer = NULL;
+  NI_Iterator iter;
+
+  lines = 1;
+  for(qq = 0; qq < array->nd; qq++)
+    lines *= array->dimensions[qq];
+  lines /= len;
+  if (!NI_InitPointIterator(array, &iter))
+    return 0;
+  if (!NI_LineIterator(&iter, axis))
+    return 0;
+  buffer = (float*)malloc(len * SPLINE_LINES * sizeof(float));
+  if (!buffer) {
+    PyErr_NoMemory();
+    return 0;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  for(kk = 0; kk < lines; kk += nb) {
+    nb = lines - kk < SPLINE_LINES ? (int)(lines - kk) : SPLINE_LINES;
+    for(bb = 0; bb < nb; bb++) {
+      starts[bb] = pa;
+      NI_ITERATOR_NEXT(iter, pa);
+    }
+    for(ll = 0; ll < len; ll++) {
+      float *ln = buffer + ll * SPLINE_LINES;
+      for(bb = 0; bb < nb; bb++)
+        ln[bb] = *(Float32*)(starts[bb] + ll * stride);
+      for(; bb < SPLINE_LINES; bb++)
+        ln[bb] = 0.0f;
+    }
+    spline_filter_lines(buffer, len, npoles, pole, weight);
+    for(ll = 0; ll < len; ll++) {
+      float *ln = buffer + ll * SPLINE_LINES;
+      for(bb = 0; bb < nb; bb++)
+        *(Float32*)(starts[bb] + ll * stride) = ln[bb];
+    }
+  }
+  Py_END_ALLOW_THREADS
+
+  free(buffer);
+  return 1;
+}
+
 /* one-dimensional spline filter: */
 int NI_SplineFilter1D(PyArrayObject *input, int order, int axis, 
                       PyArrayObject *output)
@@ -239,6 +389,13 @@ int NI_SplineFilter1D(PyArrayObject *input, int order, int axis,
   for(hh = 0; hh < npoles; hh++)
     weight *= (1.0 - pole[hh]) * (1.0 - 1.0 / pole[hh]);
 
+  /* single-precision arrays filtered in place take a faster path: */
+  if (len > 1 && same_array(input, output) &&
+      output->descr->type_num == tFloat32) {
+    spline_filter_float32(output, axis, npoles, pole, weight);
+    goto exit;
+  }
+
   /* allocate an initialize the line buffer, only a single one is used,
      because the calculation is in-place: */
   lines = -1;
@@ -357,6 +514,8 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
   Float64 *matrix = matrix_ar ? (Float64*)NA_OFFSETDATA(matrix_ar) : NULL;
   Float64 *shift = shift_ar ? (Float64*)NA_OFFSETDATA(shift_ar) : NULL;
   int irank = 0, orank, qq;
+  char *error = NULL;
+  NPY_BEGIN_THREADS_DEF
 
   for(kk = 0; kk < input->nd; kk++) {
     idimensions[kk] = input->dimensions[kk];
@@ -455,6 +614,11 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
   size = 1;
   for(qq = 0; qq < output->nd; qq++)
     size *= output->dimensions[qq];
+  /* a mapping function may call back into Python, otherwise release the
+     interpreter lock, so that other threads can transform other parts of
+     the output at the same time: */
+  if (!map)
+    NPY_BEGIN_THREADS
   for(kk = 0; kk < size; kk++) {
     double t = 0.0;
     int constant = 0, edge = 0, offset = 0;
@@ -493,8 +657,7 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
         CASE_MAP_COORDINATES(p, icoor, irank, cstride, Float32);
         CASE_MAP_COORDINATES(p, icoor, irank, cstride, Float64);
       default:
-        PyErr_SetString(PyExc_RuntimeError, 
-                        "coordinate array data type not supported");
+        error = "coordinate array data type not supported";
         goto exit;
       }
     }
@@ -586,7 +749,7 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
           CASE_INTERP_COEFF(coeff, pi, idxs[hh], Float32);        
           CASE_INTERP_COEFF(coeff, pi, idxs[hh], Float64);        
         default:
-          PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+          error = "data type not supported";
           goto exit;
         }
         /* calculate the interpolated value: */
@@ -615,7 +778,7 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
       CASE_INTERP_OUT(po, t, Float32);
       CASE_INTERP_OUT(po, t, Float64);
     default:
-      PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+      error = "data type not supported";
       goto exit;
     }
     if (coordinates) {
@@ -626,6 +789,9 @@ NI_GeometricTransform(PyArrayObject *input, int (*map)(maybelong*, double*,
   }
 
  exit:
+  NPY_END_THREADS;
+  if (error)
+    PyErr_SetString(PyExc_RuntimeError, error);
   if (edge_offsets) 
     free(edge_offsets);
   if (data_offsets) {
@@ -36,28 +36,48 @@
 #include <float.h>
 #include <assert.h>
 
-typedef struct {
-  Int32 index1, index2;
-  void* next;
-} _index_pair;
-
 #define CASE_LABEL(_p, _pi, _type) \
 case t ## _type:                   \
   *_p = *(_type*)_pi ? -1 : 0;     \
   break
 
+/* Objects that touch are merged in a union-find forest of labels, in
+   which each label points to a lower label of the same object, or to
+   itself if it is the lowest. */
+static Int32 
+label_root(Int32 *parents, Int32 label)
+{
+  while (parents[label] != label) {
+    parents[label] = parents[parents[label]];
+    label = parents[label];
+  }
+  return label;
+}
+
+static void 
+label_union(Int32 *parents, Int32 label1, Int32 label2)
+{
+  label1 = label_root(parents, label1);
+  label2 = label_root(parents, label2);
+  if (label1 < label2)
+    parents[label2] = label1;
+  else
+    parents[label1] = label2;
+}
+
 int NI_Label(PyArrayObject* input, PyArrayObject* strct,
              maybelong *max_label, PyArrayObject* output)
 {
   int kk;
   maybelong jj, ll, ssize, size, filter_size, *offsets = NULL;
-  maybelong mask_value, *oo;
+  maybelong mask_value, *oo, capacity = 0;
   Bool *ps, *footprint = NULL;
-  char *pi, *po;
-  Int32 index = 0, *index_map = NULL;
+  char *pi, *po, *error = NULL;
+  int no_memory = 0;
+  Int32 index = 0, *parents = NULL;
   NI_FilterIterator fi;
   NI_Iterator ii, io;
-  _index_pair *pairs = NULL;
+  NPY_BEGIN_THREADS_DEF
 
   /* structure size */
   ssize = 1;
@@ -89,6 +109,16 @@ int NI_Label(PyArrayObject* input, PyArrayObject* strct,
     goto exit;
   if (!NI_InitPointIterator(output, &io))
     goto exit;
+  /* calculate the filter offsets: */
+  if (!NI_InitFilterOffsets(output, footprint, strct->dimensions, NULL,
+                          NI_EXTEND_CONSTANT, &offsets, &mask_value, NULL))
+    goto exit;
+  /* initialize filter iterator: */
+  if (!NI_InitFilterIterator(input->nd, strct->dimensions, filter_size, 
+                                           input->dimensions, NULL, &fi))
+    goto exit;
+
+  NPY_BEGIN_THREADS
   /* set all elements in the output corresponding to non-zero elements
      in input to -1: */
   for(jj = 0; jj < size; jj++) {
@@ -108,20 +138,12 @@ int NI_Label(PyArrayObject* input, PyArrayObject* strct,
     CASE_LABEL(p, pi, Float32);
     CASE_LABEL(p, pi, Float64);
     default:
-      PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+      error = "data type not supported";
       goto exit;
     }
     NI_ITERATOR_NEXT2(ii, io, pi, po);
   }
 
-  /* calculate the filter offsets: */
-  if (!NI_InitFilterOffsets(output, footprint, strct->dimensions, NULL,
-                          NI_EXTEND_CONSTANT, &offsets, &mask_value, NULL))
-    goto exit;
-  /* initialize filter iterator: */
-  if (!NI_InitFilterIterator(input->nd, strct->dimensions, filter_size, 
-                                           input->dimensions, NULL, &fi))
-    goto exit;
   /* reset output iterator: */
   NI_ITERATOR_RESET(io);
   po = NA_OFFSETDATA(output);
@@ -136,27 +158,12 @@ int NI_Label(PyArrayObject* input, PyArrayObject* strct,
         if (offset != mask_value) {
           Int32 tt = *(Int32*)(po + offset);
           if (tt > 0) {
-            /* this element is next to an already found object: */
-            if (neighbor && neighbor != tt) {
-              /* we have two objects that must be merged later: */
-              _index_pair* tp = (_index_pair*)malloc(sizeof(_index_pair));
-              if (!tp) {
-                PyErr_NoMemory();
-                goto exit;
-              }
-              tp->next = pairs;
-              /* the pairs must be ordered: */
-              if (neighbor < tt) {
-                tp->index1 = neighbor;
-                tp->index2 = tt;
-              } else {
-                tp->index1 = tt;
-                tp->index2 = neighbor;
-              }
-              pairs = tp;
-            } else {
+            /* this element is next to an already found object, and
+               any other object it touches must be merged with it: */
+            if (neighbor && neighbor != tt)
+              label_union(parents, neighbor, tt);
+            else
               neighbor = tt;
-            }
           }
         }
       }
@@ -165,92 +172,158 @@ int NI_Label(PyArrayObject* input, PyArrayObject* strct,
         *(Int32*)po = neighbor;
       } else {
         /* this may be a new object: */
+        if (index + 1 >= capacity) {
+          Int32 *tmp;
+          capacity = capacity ? 2 * capacity : 1024;
+          tmp = (Int32*)realloc(parents, capacity * sizeof(Int32));
+          if (!tmp) {
+            no_memory = 1;
+            goto exit;
+          }
+          parents = tmp;
+        }
         *(Int32*)po = ++index;
+        parents[index] = index;
       }
     }
     NI_FILTER_NEXT(fi, io, oo, po);
   }
   *max_label = index;
-  /* merge any touching objects: */
-  if (pairs) {
-    Int32 counter;
-    index_map = (Int32*)malloc(index * sizeof(Int32));
-    if (!index_map) {
-      PyErr_NoMemory();
-      goto exit;
-    }
-    for(jj = 0; jj < index; jj++)
-      index_map[jj] = (Int32)jj;
-    while (pairs) {
-      Int32 idx1 = pairs->index1 - 1;
-      Int32 idx2 = pairs->index2 - 1;
-      if (index_map[idx2] == idx1 || index_map[idx2] == idx2) {
-        /* if this pair was already processed, or if idx2 was not 
-           mapped yet, we delete this pair and map idx2 to idx1: */
-        _index_pair *tp = pairs;
-        pairs = tp->next;
-        free(tp);
-        index_map[idx2] = idx1;
-      } else {
-        /* idx2 was already mapped, therefore we find what it was
-           mapped to and change the current pair to the result of that
-           and idx1. Since the pair is not destroyed, it will be
-           re-processed with the adapted values.  */
-        idx2 = index_map[idx2];
-        /* keep the pairs ordered: */
-        if (idx1 < idx2) {
-          pairs->index1 = idx1 + 1;
-          pairs->index2 = idx2 + 1;
-        } else {
-          pairs->index1 = idx2 + 1;
-          pairs->index2 = idx1 + 1;
-        }
+  if (index > 0) {
+    Int32 counter = 0;
+    /* since each label points to a lower label, in increasing order each
+       label's parent already points to the lowest label of its object.
+       The lowest labels are renumbered in order of appearance: */
+    for(jj = 1; jj <= index; jj++)
+      if (parents[jj] == jj)
+        parents[jj] = ++counter;
+      else
+        parents[jj] = parents[parents[jj]];
+    /* relabel the output if we merged some objects: */
+    if (counter < index) {
+      NI_ITERATOR_RESET(io);
+      po = NA_OFFSETDATA(output);
+      for(jj = 0; jj < size; jj++) {
+        Int32 p = *(Int32*)po;
+        if (p > 0)
+          *(Int32*)po = parents[p];
+        NI_ITERATOR_NEXT(io, po);
       }
     }
-    for(jj = 0; jj < index; jj++) {
-      /* if the current index maps to a index that is also mapped,
-         change it to map to that index. Since an index always maps to
-         a lower index or to itself, this will make sure that at the
-         end all indices map to an unmapped index. */
-      if (index_map[index_map[jj]] < index_map[jj])
-        index_map[jj] = index_map[index_map[jj]];
-    }
-    /* renumber the indices that are not mapped: */
-    counter = 0;
-    for(jj = 0; jj < index; jj++)
-      if (index_map[jj] == jj)
-        index_map[jj] = ++counter;
-      else
-        index_map[jj] = index_map[index_map[jj]];
+    *max_label = counter;
   }
+ exit:
+  NPY_END_THREADS;
+  if (no_memory)
+    PyErr_NoMemory();
+  if (error)
+    PyErr_SetString(PyExc_RuntimeError, error);
+  if (offsets) free(offsets);
+  if (parents) free(parents);
+  if (footprint)
+    free(footprint);
+  return PyErr_Occurred() ? 0 : 1;
+}
 
-  /* relabel the output if we merged some objects: */
-  if (index_map) {
-    *max_label = 0;
-    NI_ITERATOR_RESET(io);
-    po = NA_OFFSETDATA(output);
-    for(jj = 0; jj < size; jj++) {
-      Int32 p = *(Int32*)po;
-      if (p > 0 )
-        *(Int32*)po = index_map[p - 1];
-      if (*(Int32*)po > *max_label)
-        *max_label = *(Int32*)po;
-      NI_ITERATOR_NEXT(io, po);
+/* Merge the objects of two labeled blocks of an array that meet across a
+   boundary between them, in the union-find forest of parents described
+   above. The labels array holds the last row of the first block and the
+   first row of the second, whose labels are offset by offset1 and offset2
+   respectively in the forest. */
+int NI_LabelMerge(PyArrayObject* labels, PyArrayObject* strct,
+                  maybelong offset1, maybelong offset2,
+                  PyArrayObject* parents)
+{
+  int kk;
+  maybelong jj, ll, ssize, size, filter_size, *offsets = NULL;
+  maybelong mask_value, *oo;
+  Bool *ps, *footprint = NULL;
+  char *po;
+  Int32 *pp = (Int32*)NA_OFFSETDATA(parents);
+  NI_FilterIterator fi;
+  NI_Iterator io;
+
+  if (labels->nd < 1 || labels->dimensions[0] != 2) {
+    PyErr_SetString(PyExc_RuntimeError, "two rows of labels required");
+    goto exit;
+  }
+  /* only the part of the structure connecting to the previous row is
+     used: */
+  ssize = 1;
+  for(kk = 0; kk < strct->nd; kk++)
+    ssize *= strct->dimensions[kk];
+  footprint = (Bool*)malloc(ssize * sizeof(Bool));
+  if (!footprint) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+  ps = (Bool*)NA_OFFSETDATA(strct);
+  filter_size = 0;
+  for(jj = 0; jj < ssize; jj++) {
+    footprint[jj] = jj < ssize / 3 ? ps[jj] : 0;
+    if (footprint[jj])
+      ++filter_size;
+  }
+  po = NA_OFFSETDATA(labels);
+  size = 1;
+  for(kk = 0; kk < labels->nd; kk++)
+    size *= labels->dimensions[kk];
+  if (!NI_InitPointIterator(labels, &io))
+    goto exit;
+  if (!NI_InitFilterOffsets(labels, footprint, strct->dimensions, NULL,
+                          NI_EXTEND_CONSTANT, &offsets, &mask_value, NULL))
+    goto exit;
+  if (!NI_InitFilterIterator(labels->nd, strct->dimensions, filter_size, 
+                             labels->dimensions, NULL, &fi))
+    goto exit;
+  oo = offsets;
+  for(jj = 0; jj < size; jj++) {
+    /* the offsets fall outside the array for the first row: */
+    Int32 label = *(Int32*)po;
+    if (label > 0) {
+      for(ll = 0; ll < filter_size; ll++) {
+        int offset = oo[ll];
+        if (offset != mask_value) {
+          Int32 tt = *(Int32*)(po + offset);
+          if (tt > 0)
+            label_union(pp, (Int32)(label + offset2), (Int32)(tt + offset1));
+        }
+      }
     }
+    NI_FILTER_NEXT(fi, io, oo, po);
   }
  exit:
   if (offsets) free(offsets);
-  if (index_map) free(index_map);
-  while (pairs) {
-    _index_pair *tp = pairs;
-    pairs = (_index_pair*)pairs->next;
-    free(tp);
-  }
   if (footprint)
     free(footprint);
   return PyErr_Occurred() ? 0 : 1;
 }
 
+/* Replace each label of a labeled array by its entry in a map. */
+int NI_Relabel(PyArrayObject* labels, PyArrayObject* map)
+{
+  int kk;
+  maybelong jj, size;
+  char *po = NA_OFFSETDATA(labels);
+  Int32 *pm = (Int32*)NA_OFFSETDATA(map);
+  NI_Iterator io;
+  NPY_BEGIN_THREADS_DEF
+
+  size = 1;
+  for(kk = 0; kk < labels->nd; kk++)
+    size *= labels->dimensions[kk];
+  if (!NI_InitPointIterator(labels, &io))
+    goto exit;
+  NPY_BEGIN_THREADS
+  for(jj = 0; jj < size; jj++) {
+    *(Int32*)po = pm[*(Int32*)po];
+    NI_ITERATOR_NEXT(io, po);
+  }
+  NPY_END_THREADS;
+ exit:
+  return PyErr_Occurred() ? 0 : 1;
+}
+
 #define CASE_FIND_OBJECT_POINT(_pi, _regions, _rank, _dimensions, \
                                _max_label, _ii, _type)            \
 case t ## _type:                                                  \
@@ -649,6 +722,181 @@ int NI_Statistics(PyArrayObject *input, PyArrayObject *labels,
 }
 
 
+/* macro to get a value in NI_LabelStatistics, which runs without the
+   interpreter lock; the type must have been checked with
+   NI_LabelStatisticsType beforehand: */
+#if HAS_UINT64
+#define NI_LS_GET_UINT64(_p, _v) case tUInt64: _v = *(UInt64*)_p; break;
+#else
+#define NI_LS_GET_UINT64(_p, _v)
+#endif
+#define NI_LS_GET(_p, _v, _type)                                      \
+{                                                                     \
+  switch(_type) {                                                     \
+  case tBool:                                                         \
+    _v = (*(Bool*)_p) != 0;                                           \
+    break;                                                            \
+  case tUInt8:                                                        \
+    _v = *(UInt8*)_p;                                                 \
+    break;                                                            \
+  case tUInt16:                                                       \
+    _v = *(UInt16*)_p;                                                \
+    break;                                                            \
+  case tUInt32:                                                       \
+    _v = *(UInt32*)_p;                                                \
+    break;                                                            \
+  NI_LS_GET_UINT64(_p, _v)                                            \
+  case tInt8:                                                         \
+    _v = *(Int8*)_p;                                                  \
+    break;                                                            \
+  case tInt16:                                                        \
+    _v = *(Int16*)_p;                                                 \
+    break;                                                            \
+  case tInt32:                                                        \
+    _v = *(Int32*)_p;                                                 \
+    break;                                                            \
+  case tInt64:                                                        \
+    _v = *(Int64*)_p;                                                 \
+    break;                                                            \
+  case tFloat32:                                                      \
+    _v = *(Float32*)_p;                                               \
+    break;                                                            \
+  case tFloat64:                                                      \
+    _v = *(Float64*)_p;                                               \
+    break;                                                            \
+  default:                                                            \
+    _v = 0;                                                           \
+    break;                                                            \
+  }                                                                   \
+}
+
+/* return if a data type can be read by NI_LS_GET: */
+static int NI_LabelStatisticsType(int type)
+{
+  switch(type) {
+  case tBool:
+  case tUInt8:
+  case tUInt16:
+  case tUInt32:
+#if HAS_UINT64
+  case tUInt64:
+#endif
+  case tInt8:
+  case tInt16:
+  case tInt32:
+  case tInt64:
+  case tFloat32:
+  case tFloat64:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* Accumulate the statistics of the labeled objects of an array in a
+   single pass. Each object has a record of NI_LabelStatisticsSize(rank)
+   doubles in records, laid out as described in ni_measure.h. The features
+   flags select the optional parts of the records. The array may be a
+   block of the rows of a larger array, starting at row offset, so that
+   blocks can be accumulated on separate threads and their records merged;
+   positions and coordinates are those in the larger array. The
+   interpreter lock is released during the pass. */
+int NI_LabelStatistics(PyArrayObject *input, PyArrayObject *labels,
+  maybelong min_label, maybelong max_label, maybelong *indices,
+  maybelong n_results, int features, maybelong offset, double *records)
+{
+  char *pi = NULL, *pm = NULL;
+  NI_Iterator ii, mi;
+  maybelong jj, size, row_size, idx, label = 0, record_size, kk, ll;
+  int qq, rank = input->nd, itype, ltype;
+  double val = 0.0;
+  NPY_BEGIN_THREADS_DEF
+
+  record_size = NI_LabelStatisticsSize(rank);
+  if (!NI_InitPointIterator(input, &ii))
+    return 0;
+  if (!NI_InitPointIterator(labels, &mi))
+    return 0;
+  pi = NA_OFFSETDATA(input);
+  pm = NA_OFFSETDATA(labels);
+  itype = input->descr->type_num;
+  ltype = labels->descr->type_num;
+  if (!NI_LabelStatisticsType(itype) || !NI_LabelStatisticsType(ltype)) {
+    PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+    return 0;
+  }
+  size = 1;
+  for(qq = 0; qq < rank; qq++)
+    size *= input->dimensions[qq];
+  row_size = rank > 0 && input->dimensions[0] > 0 ? 
+    size / input->dimensions[0] : 1;
+  NPY_BEGIN_THREADS
+  for(jj = 0; jj < n_results; jj++) {
+    double *rr = records + jj * record_size;
+    for(kk = 0; kk < record_size; kk++)
+      rr[kk] = 0.0;
+    rr[NI_LS_MINIMUM] = DBL_MAX;
+    rr[NI_LS_MAXIMUM] = -DBL_MAX;
+    for(qq = 0; qq < rank; qq++) {
+      rr[NI_LS_BOX(rank) + qq] = DBL_MAX;
+      rr[NI_LS_BOX(rank) + rank + qq] = -DBL_MAX;
+    }
+  }
+  for(jj = 0; jj < size; jj++) {
+    NI_LS_GET(pm, label, ltype);
+    if (label >= min_label && label <= max_label &&
+        (idx = indices[label - min_label]) >= 0) {
+      double *rr = records + idx * record_size, xx[MAXDIM];
+      NI_LS_GET(pi, val, itype);
+      rr[NI_LS_COUNT] += 1.0;
+      rr[NI_LS_SUM] += val;
+      rr[NI_LS_SUM_SQUARES] += val * val;
+      if (features & NI_LS_EXTREMA) {
+        /* positions are the linear indices in the larger array: */
+        if (val < rr[NI_LS_MINIMUM]) {
+          rr[NI_LS_MINIMUM] = val;
+          rr[NI_LS_MINIMUM_POSITION] = (double)(offset * row_size + jj);
+        }
+        if (val > rr[NI_LS_MAXIMUM]) {
+          rr[NI_LS_MAXIMUM] = val;
+          rr[NI_LS_MAXIMUM_POSITION] = (double)(offset * row_size + jj);
+        }
+      }
+      if (features & (NI_LS_MOMENTS | NI_LS_BOUNDING_BOX)) {
+        for(qq = 0; qq < rank; qq++)
+          xx[qq] = (double)ii.coordinates[qq];
+        if (rank > 0)
+          xx[0] += (double)offset;
+      }
+      if (features & NI_LS_MOMENTS) {
+        double *rx = rr + NI_LS_COORDINATES;
+        double *rv = rr + NI_LS_WEIGHTED(rank);
+        double *rvv = rr + NI_LS_SECOND(rank);
+        for(qq = 0; qq < rank; qq++) {
+          rx[qq] += xx[qq];
+          rv[qq] += val * xx[qq];
+        }
+        for(kk = 0; kk < rank; kk++)
+          for(ll = kk; ll < rank; ll++)
+            *rvv++ += val * xx[kk] * xx[ll];
+      }
+      if (features & NI_LS_BOUNDING_BOX) {
+        double *rb = rr + NI_LS_BOX(rank);
+        for(qq = 0; qq < rank; qq++) {
+          if (xx[qq] < rb[qq])
+            rb[qq] = xx[qq];
+          if (xx[qq] > rb[rank + qq])
+            rb[rank + qq] = xx[qq];
+        }
+      }
+    }
+    NI_ITERATOR_NEXT2(ii, mi, pi, pm);
+  }
+  NPY_END_THREADS;
+  return 1;
+}
+
+
 int NI_CenterOfMass(PyArrayObject *input, PyArrayObject *labels, 
               maybelong min_label, maybelong max_label, maybelong *indices, 
               maybelong n_results, double *center_of_mass)
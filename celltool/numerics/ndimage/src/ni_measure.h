@@ -41,8 +41,41 @@ typedef struct {
 
 int NI_Label(PyArrayObject*, PyArrayObject*, maybelong*, PyArrayObject*);
 
+int NI_LabelMerge(PyArrayObject*, PyArrayObject*, maybelong, maybelong,
+                  PyArrayObject*);
+
+int NI_Relabel(PyArrayObject*, PyArrayObject*);
+
 int NI_FindObjects(PyArrayObject*, maybelong, maybelong*);
 
+/* layout of the record of statistics of each object accumulated by
+   NI_LabelStatistics, for an array of the given rank: the number of
+   elements, the sum and sum of squares of their values, the extrema of
+   the values and their linear positions, the sums of the coordinates,
+   of the coordinates weighted by the values, and of the products of pairs
+   of coordinates (in the order x0x0, x0x1, ... x1x1, ...) weighted by the
+   values, and the lowest and highest coordinates: */
+#define NI_LS_COUNT 0
+#define NI_LS_SUM 1
+#define NI_LS_SUM_SQUARES 2
+#define NI_LS_MINIMUM 3
+#define NI_LS_MAXIMUM 4
+#define NI_LS_MINIMUM_POSITION 5
+#define NI_LS_MAXIMUM_POSITION 6
+#define NI_LS_COORDINATES 7
+#define NI_LS_WEIGHTED(_rank) (NI_LS_COORDINATES + (_rank))
+#define NI_LS_SECOND(_rank) (NI_LS_WEIGHTED(_rank) + (_rank))
+#define NI_LS_BOX(_rank) (NI_LS_SECOND(_rank) + (_rank) * ((_rank) + 1) / 2)
+#define NI_LabelStatisticsSize(_rank) (NI_LS_BOX(_rank) + 2 * (_rank))
+
+/* optional parts of the records: */
+#define NI_LS_EXTREMA 1
+#define NI_LS_MOMENTS 2
+#define NI_LS_BOUNDING_BOX 4
+
+int NI_LabelStatistics(PyArrayObject*, PyArrayObject*, maybelong, maybelong,
+                       maybelong*, maybelong, int, maybelong, double*);
+
 int NI_CenterOfMass(PyArrayObject*, PyArrayObject*, maybelong, maybelong,
                     maybelong*, maybelong, double*);
 
@@ -490,6 +490,384 @@ int NI_BinaryErosion2(PyArrayObject* array, PyArrayObject* strct,
 }
 
 
+/* Binary morphology of 2D arrays packed 64 elements to a word. Each row
+   of a packed image occupies a whole number of words; the bits past the
+   last column hold the border value, so that shifted reads of the last
+   word see the border without extra tests. */
+
+typedef npy_uint64 packed_word;
+
+#define PACKED_BITS 64
+#define PACKED_ONES (~(packed_word)0)
+
+typedef struct {
+  packed_word *data;
+  maybelong rows, cols, words;
+  packed_word border;
+} packed_image;
+
+#define CASE_PACK_ROW(_pi, _stride, _cols, _pw, _type)     \
+case t ## _type:                                          \
+{                                                         \
+  maybelong _kk, _xx = 0;                                 \
+  for(_kk = 0; _xx < _cols; _kk++) {                      \
+    packed_word _ww = 0;                                  \
+    int _bb, _nb = _cols - _xx < PACKED_BITS ?            \
+                   (int)(_cols - _xx) : PACKED_BITS;      \
+    for(_bb = 0; _bb < _nb; _bb++, _xx++)                 \
+      _ww |= (packed_word)(*(_type*)(_pi + _xx * _stride) \
+                           != 0) << _bb;                  \
+    _pw[_kk] = _ww;                                       \
+  }                                                       \
+}                                                         \
+break
+
+static int packed_init(packed_image *image, maybelong rows, maybelong cols,
+                       int border)
+{
+  image->rows = rows;
+  image->cols = cols;
+  image->words = (cols + PACKED_BITS - 1) / PACKED_BITS;
+  image->border = border ? PACKED_ONES : 0;
+  image->data = (packed_word*)malloc((rows * image->words + 1) *
+                                     sizeof(packed_word));
+  return image->data != NULL;
+}
+
+/* the bits of the last word of a row that lie past the last column: */
+static packed_word packed_tail(packed_image *image)
+{
+  int used = image->cols % PACKED_BITS;
+  return used ? PACKED_ONES << used : 0;
+}
+
+/* pack the nonzero elements of a 2D array, the bits past the last column
+   are set to the given value: */
+static int packed_from_array(packed_image *image, PyArrayObject *array,
+                             packed_word tail_value)
+{
+  maybelong yy, words = image->words;
+  packed_word tail = packed_tail(image);
+  char *pi = NA_OFFSETDATA(array);
+
+  for(yy = 0; yy < image->rows; yy++) {
+    packed_word *pw = image->data + yy * words;
+    char *pr = pi + yy * array->strides[0];
+    maybelong stride = array->strides[1];
+    switch (array->descr->type_num) {
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Bool);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, UInt8);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, UInt16);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, UInt32);
+#if HAS_UINT64
+      CASE_PACK_ROW(pr, stride, image->cols, pw, UInt64);
+#endif
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Int8);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Int16);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Int32);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Int64);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Float32);
+      CASE_PACK_ROW(pr, stride, image->cols, pw, Float64);
+    default:
+      return 0;
+    }
+    pw[words - 1] = (pw[words - 1] & ~tail) | (tail_value & tail);
+  }
+  return 1;
+}
+
+static void packed_to_array(packed_image *image, PyArrayObject *array)
+{
+  maybelong yy, kk, xx;
+  char *po = NA_OFFSETDATA(array);
+
+  for(yy = 0; yy < image->rows; yy++) {
+    packed_word *pw = image->data + yy * image->words;
+    char *pr = po + yy * array->strides[0];
+    maybelong stride = array->strides[1];
+    for(kk = 0, xx = 0; xx < image->cols; kk++) {
+      packed_word ww = pw[kk];
+      int bb, nb = image->cols - xx < PACKED_BITS ?
+                   (int)(image->cols - xx) : PACKED_BITS;
+      for(bb = 0; bb < nb; bb++, xx++)
+        *(Bool*)(pr + xx * stride) = (Bool)((ww >> bb) & 1);
+    }
+  }
+}
+
+/* word kk of row yy, or the border outside of the image: */
+static packed_word packed_get(packed_image *image, maybelong yy,
+                              maybelong kk)
+{
+  if (yy < 0 || yy >= image->rows || kk < 0 || kk >= image->words)
+    return image->border;
+  return image->data[yy * image->words + kk];
+}
+
+/* word kk of row yy shifted such that bit ii holds the element at column
+   ii + dx relative to the start of the word: */
+static packed_word packed_shifted(packed_image *image, maybelong yy,
+                                  maybelong kk, maybelong dx)
+{
+  maybelong qq = dx >= 0 ? dx / PACKED_BITS :
+                          -((PACKED_BITS - 1 - dx) / PACKED_BITS);
+  int rr = (int)(dx - qq * PACKED_BITS);
+  if (rr == 0)
+    return packed_get(image, yy, kk + qq);
+  return (packed_get(image, yy, kk + qq) >> rr) |
+         (packed_get(image, yy, kk + qq + 1) << (PACKED_BITS - rr));
+}
+
+int NI_BinaryErosionPacked(PyArrayObject* input, PyArrayObject* strct,
+                           PyArrayObject* mask, PyArrayObject* output,
+                           int bdr_value, maybelong *origins, int invert,
+                           int niter, int *changed)
+{
+  packed_image in, out, msk;
+  maybelong *offsets = NULL, struct_size = 0, yy, kk, jj, ss;
+  maybelong rows, words;
+  packed_word tail, border;
+  Bool *ps = (Bool*)NA_OFFSETDATA(strct);
+  int iteration;
+  NPY_BEGIN_THREADS_DEF
+
+  in.data = out.data = msk.data = NULL;
+  *changed = 0;
+  if (input->nd != 2 || output->nd != 2 ||
+      output->descr->type_num != tBool) {
+    PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+    goto exit;
+  }
+  rows = input->dimensions[0];
+  /* the border takes part in the and of erosion and in the or of
+     dilation (invert) alike: */
+  border = bdr_value ? PACKED_ONES : 0;
+  if (!packed_init(&in, rows, input->dimensions[1], bdr_value) ||
+      !packed_init(&out, rows, input->dimensions[1], bdr_value) ||
+      (mask && !packed_init(&msk, rows, input->dimensions[1], 0))) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+  if (!packed_from_array(&in, input, border) ||
+      (mask && !packed_from_array(&msk, mask, 0))) {
+    PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+    goto exit;
+  }
+  /* the row and column offsets of the structuring element: */
+  ss = strct->dimensions[0] * strct->dimensions[1];
+  offsets = (maybelong*)malloc(2 * ss * sizeof(maybelong));
+  if (!offsets) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+  for(jj = 0; jj < ss; jj++) {
+    if (ps[jj]) {
+      offsets[2 * struct_size] = jj / strct->dimensions[1] -
+                          (strct->dimensions[0] / 2 + origins[0]);
+      offsets[2 * struct_size + 1] = jj % strct->dimensions[1] -
+                          (strct->dimensions[1] / 2 + origins[1]);
+      ++struct_size;
+    }
+  }
+  words = in.words;
+  tail = packed_tail(&in);
+
+  NPY_BEGIN_THREADS
+  for(iteration = 0; niter < 1 || iteration < niter; iteration++) {
+    int row_changed = 0;
+    packed_image tmp;
+    for(yy = 0; yy < rows; yy++) {
+      packed_word *pi = in.data + yy * words, *po = out.data + yy * words;
+      for(kk = 0; kk < words; kk++) {
+        packed_word value = invert ? 0 : PACKED_ONES;
+        for(jj = 0; jj < struct_size; jj++) {
+          packed_word ww = packed_shifted(&in, yy + offsets[2 * jj], kk,
+                                          offsets[2 * jj + 1]);
+          if (invert)
+            value |= ww;
+          else
+            value &= ww;
+        }
+        if (mask) {
+          packed_word mm = msk.data[yy * words + kk];
+          value = (value & mm) | (pi[kk] & ~mm);
+        }
+        po[kk] = value;
+      }
+      po[words - 1] = (po[words - 1] & ~tail) | (border & tail);
+      for(kk = 0; kk < words; kk++) {
+        if (po[kk] != pi[kk]) {
+          row_changed = 1;
+          break;
+        }
+      }
+    }
+    tmp = in;
+    in = out;
+    out = tmp;
+    *changed = row_changed;
+    if (!row_changed)
+      break;
+  }
+  NPY_END_THREADS;
+  packed_to_array(&in, output);
+
+ exit:
+  if (offsets)
+    free(offsets);
+  if (in.data)
+    free(in.data);
+  if (out.data)
+    free(out.data);
+  if (msk.data)
+    free(msk.data);
+  return PyErr_Occurred() ? 0 : 1;
+}
+
+/* fill the runs of set bits of pro that contain a bit of gen, towards the
+   higher and the lower bits of a word: */
+static packed_word packed_fill_up(packed_word gen, packed_word pro)
+{
+  gen |= pro & (gen << 1);
+  pro &= pro << 1;
+  gen |= pro & (gen << 2);
+  pro &= pro << 2;
+  gen |= pro & (gen << 4);
+  pro &= pro << 4;
+  gen |= pro & (gen << 8);
+  pro &= pro << 8;
+  gen |= pro & (gen << 16);
+  pro &= pro << 16;
+  gen |= pro & (gen << 32);
+  return gen;
+}
+
+static packed_word packed_fill_down(packed_word gen, packed_word pro)
+{
+  gen |= pro & (gen >> 1);
+  pro &= pro >> 1;
+  gen |= pro & (gen >> 2);
+  pro &= pro >> 2;
+  gen |= pro & (gen >> 4);
+  pro &= pro >> 4;
+  gen |= pro & (gen >> 8);
+  pro &= pro >> 8;
+  gen |= pro & (gen >> 16);
+  pro &= pro >> 16;
+  gen |= pro & (gen >> 32);
+  return gen;
+}
+
+/* add to row yy all elements of the mask that touch a set element in the
+   rows above and below, and then the runs of the mask in the row that
+   touch a set element. Returns whether the row changed. */
+static int propagate_row(packed_image *image, packed_image *msk,
+                         maybelong yy, int diagonal, packed_word *buffer)
+{
+  maybelong kk, words = image->words;
+  packed_word carry, *pr = image->data + yy * words;
+  packed_word *pm = msk->data + yy * words;
+  int changed = 0;
+
+  for(kk = 0; kk < words; kk++) {
+    packed_word nn = packed_get(image, yy - 1, kk) |
+                     packed_get(image, yy + 1, kk) |
+                     packed_shifted(image, yy, kk, -1) |
+                     packed_shifted(image, yy, kk, 1);
+    if (diagonal)
+      nn |= packed_shifted(image, yy - 1, kk, -1) |
+            packed_shifted(image, yy - 1, kk, 1) |
+            packed_shifted(image, yy + 1, kk, -1) |
+            packed_shifted(image, yy + 1, kk, 1);
+    buffer[kk] = pm[kk] & (pr[kk] | nn);
+  }
+  carry = 0;
+  for(kk = 0; kk < words; kk++) {
+    buffer[kk] = packed_fill_up(buffer[kk] | (carry & pm[kk]), pm[kk]);
+    carry = buffer[kk] >> (PACKED_BITS - 1);
+  }
+  carry = 0;
+  for(kk = words - 1; kk >= 0; kk--) {
+    buffer[kk] = packed_fill_down(buffer[kk] |
+                      ((carry << (PACKED_BITS - 1)) & pm[kk]), pm[kk]);
+    carry = buffer[kk] & 1;
+  }
+  for(kk = 0; kk < words; kk++) {
+    packed_word value = pr[kk] | buffer[kk];
+    if (value != pr[kk]) {
+      pr[kk] = value;
+      changed = 1;
+    }
+  }
+  return changed;
+}
+
+int NI_BinaryPropagationPacked(PyArrayObject* input, PyArrayObject* mask,
+                               PyArrayObject* output, int bdr_value,
+                               int diagonal)
+{
+  packed_image image, msk;
+  packed_word *buffer = NULL;
+  maybelong yy, kk;
+  int changed, ok = 1;
+  NPY_BEGIN_THREADS_DEF
+
+  image.data = msk.data = NULL;
+  if (input->nd != 2 || output->nd != 2 ||
+      output->descr->type_num != tBool) {
+    PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+    goto exit;
+  }
+  if (!packed_init(&image, input->dimensions[0], input->dimensions[1],
+                   bdr_value) ||
+      !packed_init(&msk, input->dimensions[0], input->dimensions[1], 0)) {
+    PyErr_NoMemory();
+    goto exit;
+  }
+  if (!packed_from_array(&image, input, image.border) ||
+      (mask && !packed_from_array(&msk, mask, 0))) {
+    PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+    goto exit;
+  }
+
+  NPY_BEGIN_THREADS
+  buffer = (packed_word*)malloc(image.words * sizeof(packed_word));
+  if (!buffer) {
+    ok = 0;
+    goto exit;
+  }
+  if (!mask) {
+    packed_word tail = packed_tail(&msk);
+    for(yy = 0; yy < msk.rows; yy++) {
+      packed_word *pm = msk.data + yy * msk.words;
+      for(kk = 0; kk < msk.words; kk++)
+        pm[kk] = PACKED_ONES;
+      pm[msk.words - 1] &= ~tail;
+    }
+  }
+  /* alternate forward and backward passes until nothing changes: */
+  do {
+    changed = 0;
+    for(yy = 0; yy < image.rows; yy++)
+      changed |= propagate_row(&image, &msk, yy, diagonal, buffer);
+    for(yy = image.rows - 1; yy >= 0; yy--)
+      changed |= propagate_row(&image, &msk, yy, diagonal, buffer);
+  } while (changed);
+  packed_to_array(&image, output);
+
+ exit:
+  NPY_END_THREADS;
+  if (!ok)
+    PyErr_NoMemory();
+  if (buffer)
+    free(buffer);
+  if (image.data)
+    free(image.data);
+  if (msk.data)
+    free(msk.data);
+  return PyErr_Occurred() ? 0 : 1;
+}
+
 #define NI_DISTANCE_EUCLIDIAN  1
 #define NI_DISTANCE_CITY_BLOCK 2
 #define NI_DISTANCE_CHESSBOARD 3
@@ -953,3 +1331,114 @@ int NI_EuclideanFeatureTransform(PyArrayObject* input,
       
   return PyErr_Occurred() ? 0 : 1;
 }
+
+/* One pass of the separable exact euclidean distance transform of
+   Felzenszwalb and Huttenlocher: replace each line along the axis of the
+   squared distances by the lower envelope of the parabolas rooted at its
+   elements. Infinite elements (no background found yet) are left out of
+   the envelope. If given, the features (flat indices of the closest
+   background elements) are carried along with the distances. */
+int NI_EuclideanDistanceLines(PyArrayObject *distances,
+                              PyArrayObject *features, int axis,
+                              double sampling)
+{
+  maybelong kk, qq, jj, nn, lines, len = distances->dimensions[axis];
+  maybelong dstride = distances->strides[axis], fstride = 0, *vv = NULL;
+  double *ff = NULL, *zz = NULL;
+  Int32 *ft = NULL;
+  char *pd = NA_OFFSETDATA(distances), *pf = NULL;
+  int type = distances->descr->type_num, ll, ok = 1;
+  NI_Iterator di, fi;
+  NPY_BEGIN_THREADS_DEF
+
+  if ((type != tFloat32 && type != tFloat64) ||
+      (features && features->descr->type_num != tInt32)) {
+    PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+    return 0;
+  }
+  if (len < 1)
+    return 1;
+  lines = 1;
+  for(ll = 0; ll < distances->nd; ll++)
+    lines *= distances->dimensions[ll];
+  lines /= len;
+  if (!NI_InitPointIterator(distances, &di) || !NI_LineIterator(&di, axis))
+    return 0;
+  if (features) {
+    if (!NI_InitPointIterator(features, &fi) ||
+        !NI_LineIterator(&fi, axis))
+      return 0;
+    pf = NA_OFFSETDATA(features);
+    fstride = features->strides[axis];
+  }
+
+  NPY_BEGIN_THREADS
+  ff = (double*)malloc(len * sizeof(double));
+  zz = (double*)malloc(len * sizeof(double));
+  vv = (maybelong*)malloc(len * sizeof(maybelong));
+  ft = (Int32*)malloc(len * sizeof(Int32));
+  if (!ff || !zz || !vv || !ft) {
+    ok = 0;
+    goto exit;
+  }
+  for(kk = 0; kk < lines; kk++) {
+    for(qq = 0; qq < len; qq++)
+      ff[qq] = type == tFloat32 ? *(Float32*)(pd + qq * dstride) :
+                                  *(Float64*)(pd + qq * dstride);
+    if (features)
+      for(qq = 0; qq < len; qq++)
+        ft[qq] = *(Int32*)(pf + qq * fstride);
+    /* the lower envelope: parabola vv[jj] is lowest from zz[jj] on */
+    nn = -1;
+    for(qq = 0; qq < len; qq++) {
+      double xq = qq * sampling, zq = -HUGE_VAL;
+      if (ff[qq] >= HUGE_VAL)
+        continue;
+      while(nn >= 0) {
+        double xp = vv[nn] * sampling;
+        zq = ((ff[qq] + xq * xq) - (ff[vv[nn]] + xp * xp)) /
+             (2.0 * (xq - xp));
+        if (zq > zz[nn])
+          break;
+        --nn;
+        zq = -HUGE_VAL;
+      }
+      ++nn;
+      vv[nn] = qq;
+      zz[nn] = zq;
+    }
+    if (nn >= 0) {
+      jj = 0;
+      for(qq = 0; qq < len; qq++) {
+        double xq = qq * sampling, dd;
+        while(jj < nn && zz[jj + 1] < xq)
+          ++jj;
+        dd = xq - vv[jj] * sampling;
+        dd = dd * dd + ff[vv[jj]];
+        if (type == tFloat32)
+          *(Float32*)(pd + qq * dstride) = (Float32)dd;
+        else
+          *(Float64*)(pd + qq * dstride) = dd;
+        if (features)
+          *(Int32*)(pf + qq * fstride) = ft[vv[jj]];
+      }
+    }
+    NI_ITERATOR_NEXT(di, pd);
+    if (features)
+      NI_ITERATOR_NEXT(fi, pf);
+  }
+
+ exit:
+  NPY_END_THREADS;
+  if (!ok)
+    PyErr_NoMemory();
+  if (ff)
+    free(ff);
+  if (zz)
+    free(zz);
+  if (vv)
+    free(vv);
+  if (ft)
+    free(ft);
+  return PyErr_Occurred() ? 0 : 1;
+}
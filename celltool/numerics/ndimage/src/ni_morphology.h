@@ -36,11 +36,16 @@ int NI_BinaryErosion(PyArrayObject*, PyArrayObject*, PyArrayObject*,
      PyArrayObject*, int, maybelong*, int, int, int*, NI_CoordinateList**);
 int NI_BinaryErosion2(PyArrayObject*, PyArrayObject*, PyArrayObject*,
                       int, maybelong*, int, NI_CoordinateList**);
+int NI_BinaryErosionPacked(PyArrayObject*, PyArrayObject*, PyArrayObject*,
+                           PyArrayObject*, int, maybelong*, int, int, int*);
+int NI_BinaryPropagationPacked(PyArrayObject*, PyArrayObject*,
+                               PyArrayObject*, int, int);
 int NI_DistanceTransformBruteForce(PyArrayObject*, int, PyArrayObject*,
                                    PyArrayObject*, PyArrayObject*);
 int NI_DistanceTransformOnePass(PyArrayObject*, PyArrayObject *,
                                 PyArrayObject*);
 int NI_EuclideanFeatureTransform(PyArrayObject*, PyArrayObject*, 
                                  PyArrayObject*);
+int NI_EuclideanDistanceLines(PyArrayObject*, PyArrayObject*, int, double);
 
 #endif
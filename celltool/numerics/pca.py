@@ -100,17 +100,195 @@ def pca_dimensionality_reduce(data, required_variance_explained):
   num = bisect.bisect(total_variance, required_variance_explained) + 1
   return mean, pcs[:num], norm_pcs[:num], variances[:num], numpy.sum(variances), positions[:,:num], norm_positions[:,:num]
 
-def pca_reconstruct(scores, pcs, mean):
+def randomized_pca_dimensionality_reduce(data, required_variance_explained, initial_modes = 10,
+    oversamples = 10, power_iterations = 2, block_rows = 65536, seed = 0):
+  """Perform a truncated PCA, finding only as many principal components as are
+  required to explain the given fraction of the total variance.
+
+  The leading components are estimated with a randomized range-finder (see
+  Halko, Martinsson, and Tropp, SIAM Review 53:217, 2011): the data are
+  multiplied by a random matrix with (modes + oversamples) columns, and the
+  range of the result is refined with 'power_iterations' rounds of subspace
+  iteration; the SVD of the data projected onto that small subspace gives the
+  components. If the components found do not explain enough of the variance,
+  the number of modes is doubled (starting from 'initial_modes') and the
+  process repeated. The data are never centered in memory and the covariance
+  matrix is never formed: the centering is applied implicitly to products
+  with the data, which are computed 'block_rows' data points at a time. Thus
+  very large data sets (e.g. from many contours) can be analyzed.
+
+  The return values are as for pca_dimensionality_reduce:
+  (mean, pcs, norm_pcs, variances, total_variance, positions, norm_positions)
+  """
+  data = numpy.asarray(data)
+  flat, data_point_shape = utility_tools.flatten_data(data)
+  data_count, dimensions = flat.shape
+  max_modes = min(data_count, dimensions)
+  mean = numpy.zeros(dimensions)
+  for start in range(0, data_count, block_rows):
+    mean += flat[start:start+block_rows].sum(axis = 0)
+  mean /= data_count
+  total_variance = 0
+  for start in range(0, data_count, block_rows):
+    total_variance += ((flat[start:start+block_rows] - mean)**2).sum()
+  total_variance /= data_count
+  random = numpy.random.RandomState(seed)
+  modes = min(initial_modes, max_modes)
+  while True:
+    samples = min(modes + oversamples, max_modes)
+    q = _orthonormalize(_centered_dot(flat, mean, random.standard_normal((dimensions, samples)), block_rows))
+    for i in range(power_iterations):
+      z = _orthonormalize(_centered_transpose_dot(flat, mean, q, block_rows))
+      q = _orthonormalize(_centered_dot(flat, mean, z, block_rows))
+    # b = q'(flat - mean), which is small: (samples, dimensions)
+    b = _centered_transpose_dot(flat, mean, q, block_rows).transpose()
+    u, s, vt = numpy.linalg.svd(b, full_matrices = 0)
+    variances = s[:modes]**2 / data_count
+    explained = numpy.add.accumulate(variances / total_variance)
+    if explained[-1] > required_variance_explained or modes >= max_modes:
+      break
+    modes = min(2 * modes, max_modes)
+  num = min(bisect.bisect(explained, required_variance_explained) + 1, len(variances))
+  pcs = vt[:num]
+  variances = variances[:num]
+  stds = numpy.sqrt(variances)
+  positions = _centered_dot(flat, mean, pcs.transpose(), block_rows)
+  err = numpy.seterr(divide='ignore', invalid='ignore')
+  norm_positions = positions / stds
+  numpy.seterr(**err)
+  norm_positions = numpy.where(numpy.isfinite(norm_positions), norm_positions, 0)
+  norm_pcs = utility_tools.fatten_data(pcs * stds[:, numpy.newaxis], data_point_shape)
+  pcs = utility_tools.fatten_data(pcs, data_point_shape)
+  mean = utility_tools.fatten_data(mean[numpy.newaxis, :], data_point_shape)[0]
+  return mean, pcs, norm_pcs, variances, total_variance, positions, norm_positions
+
+def _centered_dot(flat, mean, m, block_rows):
+  """Return dot(flat - mean, m), without forming (flat - mean)."""
+  out = numpy.empty((len(flat), m.shape[1]))
+  offset = numpy.dot(mean, m)
+  for start in range(0, len(flat), block_rows):
+    out[start:start+block_rows] = numpy.dot(flat[start:start+block_rows], m) - offset
+  return out
+
+def _centered_transpose_dot(flat, mean, m, block_rows):
+  """Return dot((flat - mean)', m), without forming (flat - mean)."""
+  out = numpy.zeros((flat.shape[1], m.shape[1]))
+  for start in range(0, len(flat), block_rows):
+    out += numpy.dot(flat[start:start+block_rows].transpose(), m[start:start+block_rows])
+  out -= numpy.outer(mean, m.sum(axis = 0))
+  return out
+
+def _orthonormalize(m):
+  q, r = numpy.linalg.qr(m)
+  return q
+
+class CovarianceAccumulator(object):
+  """Accumulate the mean and covariance of a stream of data points in a single
+  pass, so that PCA can be performed on data sets too large to fit in memory.
+
+  Data points are added in chunks (arrays where 'chunk[i]' is the ith data
+  point) with the add method. The mean and the matrix of summed squared
+  deviations from the mean are updated from those of each chunk with the
+  pairwise formulas of Chan, Golub, and LeVeque (Am. Stat. 37:242, 1983),
+  which are numerically stable. Only (dimensions x dimensions) values are
+  stored, regardless of how many data points are added.
+  """
+  def __init__(self):
+    self.count = 0
+    self.mean = None
+    self.scatter = None
+    self.data_point_shape = None
+
+  def add(self, chunk):
+    """Add a chunk of data points (packed such that 'chunk[i]' is the ith data
+    point) to the accumulated statistics."""
+    flat, data_point_shape = utility_tools.flatten_data(chunk)
+    chunk_count = len(flat)
+    if chunk_count == 0:
+      return
+    if self.count == 0:
+      self.data_point_shape = data_point_shape
+    elif data_point_shape != self.data_point_shape:
+      raise ValueError('All data points must have the same shape.')
+    flat = flat.astype(float)
+    chunk_mean = flat.mean(axis = 0)
+    flat -= chunk_mean
+    chunk_scatter = numpy.dot(flat.transpose(), flat)
+    if self.count == 0:
+      self.mean = chunk_mean
+      self.scatter = chunk_scatter
+    else:
+      total = self.count + chunk_count
+      delta = chunk_mean - self.mean
+      self.mean += delta * (float(chunk_count) / total)
+      self.scatter += chunk_scatter
+      self.scatter += numpy.outer(delta, delta) * (float(self.count) * chunk_count / total)
+    self.count += chunk_count
+
+  def covariance(self):
+    """Return the (flattened) covariance matrix of the data points so far."""
+    return self.scatter / self.count
+
+  def pca_dimensionality_reduce(self, required_variance_explained):
+    """Perform PCA on the accumulated data, retaining enough principal
+    components to explain the given fraction of the total variance.
+    Returns (mean, pcs, norm_pcs, variances, total_variance), as with
+    pca_dimensionality_reduce. (The positions of the data points along the
+    components can be found in a second pass with pca_decompose.)"""
+    if self.count == 0:
+      raise ValueError('No data points have been added.')
+    variances, vectors = _eigh(self.covariance())
+    variances = numpy.where(variances < 0, 0, variances)
+    total_variance = numpy.sum(variances)
+    explained = numpy.add.accumulate(variances / total_variance)
+    num = bisect.bisect(explained, required_variance_explained) + 1
+    pcs = vectors[:,:num].transpose()
+    variances = variances[:num]
+    norm_pcs = utility_tools.fatten_data(pcs * numpy.sqrt(variances)[:, numpy.newaxis], self.data_point_shape)
+    pcs = utility_tools.fatten_data(pcs, self.data_point_shape)
+    mean = utility_tools.fatten_data(self.mean[numpy.newaxis, :], self.data_point_shape)[0]
+    return mean, pcs, norm_pcs, variances, total_variance
+
+def pca_reconstruct(scores, pcs, mean, dtype = None):
+  """Reconstruct data points from their positions ('scores', packed such that
+  'scores[i]' are the positions of the ith data point) along the given
+  principal components, with a single matrix multiply. If 'dtype' is given
+  (e.g. numpy.float32), the calculation is done with that precision."""
   # scores and pcs are indexed along axis zero
   flat, data_point_shape = utility_tools.flatten_data(pcs)
+  scores = numpy.asarray(scores)
+  if dtype is not None:
+    flat = flat.astype(dtype)
+    scores = scores.astype(dtype)
+    mean = numpy.asarray(mean).astype(dtype)
   return mean + utility_tools.fatten_data(numpy.dot(scores, flat), data_point_shape)
 
-def pca_decompose(data, pcs, mean, variances = None):
+def pca_decompose(data, pcs, mean, variances = None, dtype = None, block_rows = 65536):
+  """Find the positions of data points (packed such that 'data[i]' is the ith
+  data point) along the given principal components. If 'variances' is given,
+  return both the positions and the normalized positions (in terms of standard
+  deviations along each component).
+
+  The data are centered and projected onto the components 'block_rows' data
+  points at a time, so a full centered copy of the data is never made, and
+  each block is projected with a single matrix multiply. The calculation is
+  done in double precision, unless another 'dtype' (e.g. numpy.float32) is
+  given.
+  """
   flat_pcs, data_point_shape = utility_tools.flatten_data(pcs)
-  flat_data, data_point_shape = utility_tools.flatten_data(data - mean)
-  projection = numpy.dot(flat_data, flat_pcs.transpose())
+  flat_data, data_point_shape = utility_tools.flatten_data(data)
+  flat_mean = numpy.reshape(mean, (-1,))
+  if dtype is None:
+    dtype = float
+  flat_pcs_t = flat_pcs.transpose().astype(dtype)
+  flat_mean = flat_mean.astype(dtype)
+  projection = numpy.empty((len(flat_data), len(flat_pcs)), dtype = dtype)
+  for start in range(0, len(flat_data), block_rows):
+    block = flat_data[start:start+block_rows].astype(dtype)
+    block -= flat_mean
+    projection[start:start+block_rows] = numpy.dot(block, flat_pcs_t)
   if variances is not None:
-    normalized_projection = projection / numpy.sqrt(variances)
+    normalized_projection = projection / numpy.sqrt(variances).astype(dtype)
     return projection, normalized_projection
   else:
     return projection
\ No newline at end of file
@@ -19,6 +19,25 @@ def configuration(parent_package='',top_path=None):
       sources=["_closest_point_transformmodule.cpp"],
       include_dirs=['stlib', numpy.get_include()],
       extra_compile_args=["-fpermissive"])
+    
+    config.add_extension("_kde",
+      sources=["_kdemodule.cpp"],
+      include_dirs=['stlib', numpy.get_include()],
+      extra_compile_args=["-fpermissive"])
+    
+    config.add_extension("_ks_resample",
+      sources=["_ks_resamplemodule.cpp"],
+      include_dirs=['stlib', numpy.get_include()],
+      extra_compile_args=["-fpermissive"])
+    
+    config.add_extension("_image_warp",
+      sources=["_image_warpmodule.cpp"],
+      include_dirs=numpy.get_include(),
+      extra_compile_args=["-O3"])
+    
+    config.add_extension("_central_axis",
+      sources=["_central_axismodule.cpp"],
+      include_dirs=numpy.get_include() )
       
     config.add_subpackage('ndimage')
     config.add_subpackage('fitpack')
@@ -0,0 +1,168 @@
+# Copyright 2007 Zachary Pincus
+# This file is part of CellTool.
+#
+# CellTool is free software; you can redistribute it and/or modify
+# it under the terms of version 2 of the GNU General Public License as
+# published by the Free Software Foundation.
+
+"""Apply ndimage filters to images too large to fit in memory.
+
+The images are processed one tile at a time: each tile is read together with
+a margin (the "halo") of the pixels around it that the filter needs, filtered
+in memory with the usual ndimage functions, and the interior of the result is
+written to the output. The input can thus be a numpy.memmap over an image file
+on disk, or any other array-like object that reads the requested slices from
+a chunked store (such as an HDF5 dataset), and the output can be a new
+memory-mapped file. Tiles are distributed over a pool of threads; only as many
+tiles as there are threads are held in memory at once.
+"""
+
+import numpy
+import ndimage
+import celltool.utility.thread_tools as thread_tools
+
+# number of elements in a tile if no tile shape is given: 16 MB of float32.
+_tile_elements = 4 * 1024 * 1024
+
+def tiled_filter(input, function, halo, output = None, dtype = None,
+    tile_shape = None, threads = None):
+  """Calculate function(input) tile by tile, where function is a filter that
+  returns an array of the same shape as its argument, such as
+    lambda tile: ndimage.gaussian_filter(tile, 5)
+
+  The halo gives the number of pixels on each side of a pixel (as a single
+  number or one per axis) that the filter reads to calculate that pixel. Tiles
+  are read with this margin, so the result equals (up to rounding) that of
+  filtering the whole image at once; at the edges of the image the filter's
+  own boundary mode applies as usual (except for mode='wrap', which reads
+  pixels from the opposite edge and so cannot be used). Typical halos are:
+    gaussian_filter(sigma):          int(4 * sigma + 0.5)
+    uniform, minimum, maximum, median and rank filters of size s: s // 2,
+      plus the absolute value of the origin if one is given
+    grey morphology with a structure of shape s: s // 2
+    binary_erosion and binary_dilation: iterations * (s // 2)
+  Filters that are not local (label, binary_fill_holes, binary_propagation
+  and the recursive gaussian) cannot be computed exactly from tiles.
+
+  'input' can be a numpy array or memmap, or any object with 'shape' and
+  'dtype' attributes whose slices are arrays. 'output' can be None (a new
+  array is returned), the name of a file (a new memory-mapped file of raw
+  pixel data is created), or an existing array-like object of the same shape
+  as the input. 'dtype' gives the type of a newly created output, by default
+  that of the input. The 'tile_shape' (by default about four million pixels)
+  does not include the halo. Tiles are filtered on 'threads' threads (by
+  default one per processor), so the filter itself should be told to use one
+  thread (threads=1) if it can use several.
+
+  Returns the output.
+  """
+  shape = tuple(input.shape)
+  halo = _per_axis(halo, len(shape))
+  if dtype is None:
+    dtype = input.dtype
+  output = _make_output(output, shape, dtype)
+  tile_shape = _tile_shape(shape, tile_shape)
+  def filter_tile(tile):
+    read = []
+    interior = []
+    for (start, stop), h, size in zip(tile, halo, shape):
+      low = max(0, start - h)
+      high = min(size, stop + h)
+      read.append(slice(low, high))
+      interior.append(slice(start - low, stop - low))
+    result = function(numpy.asarray(input[tuple(read)]))
+    output[tuple([slice(start, stop) for start, stop in tile])] = result[tuple(interior)]
+  thread_tools.thread_map(filter_tile, _tiles(shape, tile_shape), threads)
+  return output
+
+def tiled_distance_transform_edt(input, output = None, sampling = None,
+    dtype = numpy.float32, tile_elements = None, threads = None):
+  """Calculate the exact euclidean distance transform of an image that does
+  not fit in memory, as ndimage.distance_transform_edt does for arrays in
+  memory (only the distances, not the indices).
+
+  The transform is separable: the output first receives the squared distances
+  along the lines of the first axis, computed from the input, which are then
+  updated along the lines of each further axis. Each pass reads strips of
+  whole lines along its axis, of about 'tile_elements' pixels each (by default
+  about four million), and the strips are processed on 'threads' threads.
+  'input', 'output' and the returned value are as for tiled_filter; the output
+  is float32 by default, which halves the size of the file.
+  """
+  shape = tuple(input.shape)
+  if sampling is None:
+    sampling = [1.0] * len(shape)
+  else:
+    sampling = [float(s) for s in _per_axis(sampling, len(shape))]
+  output = _make_output(output, shape, dtype)
+  if tile_elements is None:
+    tile_elements = _tile_elements
+  for axis in range(len(shape)):
+    def transform(tile):
+      region = tuple([slice(start, stop) for start, stop in tile])
+      if axis == 0:
+        squared = numpy.zeros([stop - start for start, stop in tile], dtype)
+        squared[numpy.asarray(input[region]) != 0] = numpy.inf
+      else:
+        squared = numpy.array(output[region], dtype=dtype)
+      ndimage.euclidean_distance_lines(squared, axis, sampling[axis])
+      if axis == len(shape) - 1:
+        numpy.sqrt(squared, squared)
+      output[region] = squared
+    thread_tools.thread_map(transform, _tiles(shape, _strip_shape(shape, axis, tile_elements)), threads)
+  return output
+
+def _per_axis(value, rank):
+  try:
+    value = list(value)
+  except TypeError:
+    value = [value] * rank
+  if len(value) != rank:
+    raise ValueError('A value must be given for each of the %d axes.'%rank)
+  return value
+
+def _make_output(output, shape, dtype):
+  if output is None:
+    return numpy.empty(shape, dtype=dtype)
+  if isinstance(output, basestring):
+    return numpy.memmap(output, dtype=dtype, mode='w+', shape=shape)
+  if tuple(output.shape) != shape:
+    raise ValueError('The output must have the same shape as the input.')
+  return output
+
+def _tile_shape(shape, tile_shape, elements = None):
+  """Return the given tile shape, or one of about 'elements' pixels spread
+  evenly over the axes."""
+  if tile_shape is not None:
+    return [max(1, int(t)) for t in _per_axis(tile_shape, len(shape))]
+  if elements is None:
+    elements = _tile_elements
+  side = max(1, int(elements ** (1.0 / max(1, len(shape)))))
+  return [side] * len(shape)
+
+def _strip_shape(shape, axis, elements):
+  """Return the shape of tiles that contain whole lines along the given axis
+  and about 'elements' pixels, the remaining pixels spread evenly over the
+  other axes."""
+  others = len(shape) - 1
+  across = max(1, elements // max(1, shape[axis]))
+  side = max(1, int(across ** (1.0 / max(1, others))))
+  strip = [side] * len(shape)
+  strip[axis] = shape[axis]
+  return strip
+
+def _tiles(shape, tile_shape):
+  """Generate the tiles covering an array of the given shape, each as a list
+  of (start, stop) pairs, one per axis."""
+  if not shape or min(shape) == 0:
+    return
+  starts = [0] * len(shape)
+  while True:
+    yield [(start, min(start + t, size)) for start, t, size in zip(starts, tile_shape, shape)]
+    for axis in range(len(shape) - 1, -1, -1):
+      starts[axis] += tile_shape[axis]
+      if starts[axis] < shape[axis]:
+        break
+      starts[axis] = 0
+    else:
+      return
@@ -456,7 +456,7 @@ def distribution_plot(data_groups, filename, axis_title = None, plot_title = Non
     if fix_xrange[0] is not None and range_min < min: range_min=min
     if fix_xrange[1] is not None and range_max > max: range_max=max
     eval_points = list(numpy.linspace(range_min, range_max, 100, True))
-    kde_points = estimator.evaluate(eval_points) * scale_factor
+    kde_points = estimator.evaluate_tree(eval_points)[0] * scale_factor
     data_height = kde_points.max()
     if data_height > height: height = data_height
     #s = 0.0005 * numpy.min([range_max - range_min, data_height]) / 100
@@ -485,7 +485,7 @@ def distribution_plot(data_groups, filename, axis_title = None, plot_title = Non
     plot.style.add_selector('[class~="legend"][id="%s"]'%name, fill='none', stroke=color)
     if plot_points:
     	values = numpy.unique(data_group)
-    	for point in zip(values, estimator(values)):
+    	for point in zip(values, estimator.evaluate_tree(values)[0]):
     	  plot.add_circle(point, point_radius, id=None, svg_class="data point", layer=name, in_data_coords=True)
   if legend:
     legend_x = _CANVAS_WIDTH - _PAD - 80
@@ -9,6 +9,7 @@ from celltool.utility.terminal_tools import progress_list, IndeterminantProgress
 import celltool.contour.contour_class as contour_class
 import celltool.contour.contour_tools as contour_tools
 import celltool.utility.warn_tools as warn_tools
+import celltool.utility.thread_tools as thread_tools
 import celltool.utility.path as path
 import numpy
 
@@ -109,7 +110,8 @@ def resample_contours(contours, resample_points = 100, smoothing = 0, show_progr
   step_size = 0.2
   return [contour.as_resampled(resample_points, smoothing, max_iters, min_rms_change, step_size) for contour in contours]
 
-def find_centerlines(contours, centerline_points = 25, endpoints = 'horizontal', show_progress = False):
+def find_centerlines(contours, centerline_points = 25, endpoints = 'horizontal', show_progress = False,
+    threads = None):
   """Finds the midlines of a set of contours and returns a new set of 
   CentralAxisContour objects.
   
@@ -132,9 +134,15 @@ def find_centerlines(contours, centerline_points = 25, endpoints = 'horizontal',
         "curvature" means that the points of maximal contour curvature will
            be selected, under the constraint that the points must be separated
            by at least 1/3 of the contour perimeter.
+        "medial" means that the longest path through the contour's medial
+           axis (as calculated from a distance map) will be used as the
+           initial axis, which is then relaxed only once, at the final number
+           of points. This is fastest, and best for branched or bent shapes.
         (start, end): a pair of numbers indicates that these points are to be
            used as the endpoints
     - show_progress: display a simple progress bar during this process.
+    - threads: number of contours to process in parallel. If None, one thread
+        per processor is used.
   
   Reurns a list of the resampled contours.
   """
@@ -146,15 +154,19 @@ def find_centerlines(contours, centerline_points = 25, endpoints = 'horizontal',
     method = None
   except:
     if endpoints not in _centerline_methods:
-      raise ValueError('"endpoints" parameter must be one of "distance", "vertical", "horizontal", "curvature", or a (start, end) pair')
+      raise ValueError('"endpoints" parameter must be one of "distance", "vertical", "horizontal", "curvature", "medial", or a (start, end) pair')
     method = _centerline_methods[endpoints]
-  centerline_contours = []
-  for contour in contours:
-    if method is not None:
-      start, end = method(contour)
-    new_contour = contour_class.CentralAxisContour.from_contour(contour, start, end, centerline_points)
-    centerline_contours.append(new_contour)
-  return centerline_contours
+  def find_centerline(contour):
+    initial_axis = None
+    if method is None:
+      contour_start, contour_end = start, end
+    elif method is _find_medial_axis:
+      initial_axis, contour_start, contour_end = method(contour)
+    else:
+      contour_start, contour_end = method(contour)
+    return contour_class.CentralAxisContour.from_contour(contour, contour_start, contour_end,
+      centerline_points, initial_axis=initial_axis)
+  return thread_tools.thread_map(find_centerline, contours, threads)
 
 def _find_max_distance(contour):
   import celltool.numerics.utility_tools as utility_tools
@@ -193,11 +205,15 @@ def _find_max_curvatures(contour):
     end = ordered_maxima[distances.argmax()]
   return start, end
 
+def _find_medial_axis(contour):
+  return contour_tools.find_medial_axis(contour)
+
 _centerline_methods = {
   'distance': _find_max_distance,
   'vertical': _find_vertical_bound,
   'horizontal': _find_horizontal_bound,
-  'curvature': _find_max_curvatures
+  'curvature': _find_max_curvatures,
+  'medial': _find_medial_axis
 }
 
 
@@ -273,7 +289,8 @@ def align_contours_to(contours, reference, global_align = True, align_steps = 8,
   # return the original container, not the one that might have been turned into a progress_list...
   return contour_container
 
-def align_contours(contours, align_steps = 8, allow_reflection = False, max_iters = 10, quick = False, show_progress = False):
+def align_contours(contours, align_steps = 8, allow_reflection = False, max_iters = 10, quick = False, show_progress = False,
+    online = False):
   """Mutually align a set of contours to their mean in an expectation-maximization
   fashion.
   
@@ -297,6 +314,9 @@ def align_contours(contours, align_steps = 8, allow_reflection = False, max_iter
        the global search steps. This will provide a rough and sub-optimal, but
        fast, alignment.
     - show_progress: display a simple progress bar during this process.
+    - online: if True, update the mean after each contour is aligned, rather
+       than after each full iteration. This usually converges in fewer
+       iterations.
 
   Reurns a list of the aligned contours.
 
@@ -316,7 +336,8 @@ def align_contours(contours, align_steps = 8, allow_reflection = False, max_iter
   allow_scaling = False
   weights = None
   min_rms_change = None
-  iters = contour_tools.align_contours(contours, align_steps, allow_reflection, allow_scaling, weights, max_iters, min_rms_change, quick, callback)
+  iters = contour_tools.align_contours(contours, align_steps, allow_reflection, allow_scaling, weights, max_iters, min_rms_change, quick, callback,
+    online)
   if iters == max_iters:
     warn_tools.warn('Contour alignment did not converge after %d iterations.'%max_iters)
   return contours
@@ -349,13 +370,15 @@ def grid_contours(contours, grid_shape=None):
     new_contours.append(contour)
   return new_contours
 
-def make_shape_model(contours, required_variance_explained = 0.95):
+def make_shape_model(contours, required_variance_explained = 0.95, randomized = False):
   """Make a PCA shape model from a set of contours.
   
   Parameters:
     - contours: a list of contour objects.
     - required_variance_explained: the fraction of total shape variance that
         should be explained by the returned PCA shape modes.
+    - randomized: if True, calculate only the required shape modes with a
+        fast randomized algorithm. Useful for very large sets of contours.
   
   Returns a (shape_model, header, rows, norm_header, norm_rows) tuple, where
   'shape_model' is an instance of the class celltool.contour_class.PCAContour,
@@ -366,7 +389,8 @@ def make_shape_model(contours, required_variance_explained = 0.95):
     each mode.
   """
   return_positions = True
-  shape_model, positions, norm_positions = contour_class.PCAContour.from_contours(contours, required_variance_explained, return_positions)
+  shape_model, positions, norm_positions = contour_class.PCAContour.from_contours(contours, required_variance_explained, return_positions,
+    randomized)
   norm_header = ['Contour'] + ['Mode %d (normalized)' %(i+1) for i in range(len(positions[0]))]
   header = ['Contour'] + ['Mode %d' %(i+1) for i in range(len(positions[0]))]
   norm_rows = []
@@ -376,6 +400,53 @@ def make_shape_model(contours, required_variance_explained = 0.95):
     norm_rows.append([c.simple_name()] + list(n))
   return shape_model, header, rows, norm_header, norm_rows
 
+def make_shape_model_from_files(filenames, required_variance_explained = 0.95, chunk_size = 1000,
+    show_progress = False):
+  """Make a PCA shape model from a set of contour files, without loading all
+  of the contours into memory at once. This is useful for very large data
+  sets. Each file is read twice: once to build the shape model, and once to
+  find the position of each contour along the shape modes.
+  
+  Parameters:
+    - filenames: a list of contour file names.
+    - required_variance_explained: the fraction of total shape variance that
+        should be explained by the returned PCA shape modes.
+    - chunk_size: number of contours to process at a time.
+    - show_progress: display a simple progress bar during this process.
+  
+  Returns a (shape_model, header, rows, norm_header, norm_rows) tuple, as
+  with make_shape_model.
+  """
+  def contours(message):
+    if show_progress:
+      names = progress_list(filenames, message)
+    else:
+      names = filenames
+    for name in names:
+      yield contour_class.from_file(name)
+  shape_model = contour_class.PCAContour.from_contour_stream(contours('Building Shape Model'),
+    required_variance_explained, chunk_size)
+  modes = len(shape_model.standard_deviations)
+  norm_header = ['Contour'] + ['Mode %d (normalized)' %(i+1) for i in range(modes)]
+  header = ['Contour'] + ['Mode %d' %(i+1) for i in range(modes)]
+  norm_rows = []
+  rows = []
+  chunk = []
+  for c in contours('Finding Shape Model Positions'):
+    chunk.append(c)
+    if len(chunk) == chunk_size:
+      _add_position_rows(shape_model, chunk, rows, norm_rows)
+      chunk = []
+  if chunk:
+    _add_position_rows(shape_model, chunk, rows, norm_rows)
+  return shape_model, header, rows, norm_header, norm_rows
+
+def _add_position_rows(shape_model, contours, rows, norm_rows):
+  positions, norm_positions = shape_model.find_positions(contours)
+  for c, p, n in zip(contours, positions, norm_positions):
+    rows.append([c.simple_name()] + list(p))
+    norm_rows.append([c.simple_name()] + list(n))
+
 def reorient_images(contours, image_names, new_names, pad_factor = 1.2, mask = True, show_progress = False):
   """Reorient a set of images to be aligned to the input contours.
   
@@ -522,7 +593,10 @@ def measure_contours(contours, show_progress = False, *measurements):
     must have two methods: 'header', which produces a list of the names of the
     measurements that will be made (called as 'measurement.header(contours)'), 
     and 'measure', which must produce a list of measurements (the same length
-    as the header list) when called on a single contour object.
+    as the header list) when called on a single contour object. Measurement
+    objects may also have a 'measure_all' method, which is called once with
+    the whole list of contours and must return a list of the measurements for
+    each; this is used in preference to 'measure' if present.
 
   Reurns a (header, measurements) tuple, where header is a list of the names
   of all the measurements made, and measurements is a list of the measurements
@@ -535,13 +609,20 @@ def measure_contours(contours, show_progress = False, *measurements):
   header = ['Contour']
   for measurement in measurements:
     header.extend(measurement.header(contours))
+  bulk_measurements = {}
+  for i, measurement in enumerate(measurements):
+    if hasattr(measurement, 'measure_all'):
+      bulk_measurements[i] = measurement.measure_all(contours)
   if show_progress:
     contours = progress_list(contours, 'Measuring Contours', lambda c: c._filename)
   all_measurements = []
-  for contour in contours:
+  for j, contour in enumerate(contours):
     contour_measurements = [contour.simple_name()]
-    for measurement in measurements:
-      measure = measurement.measure(contour)
+    for i, measurement in enumerate(measurements):
+      if i in bulk_measurements:
+        measure = bulk_measurements[i][j]
+      else:
+        measure = measurement.measure(contour)
       contour_measurements.extend(measure)
     all_measurements.append(contour_measurements)
   return header, all_measurements
@@ -771,6 +852,12 @@ class ShapeModeMeasurement(object):
     positions = self.shape_model.find_position(contour, self.normalized)
     return positions.take([m-1 for m in self.modes])
 
+  def measure_all(self, contours):
+    positions, normalized_positions = self.shape_model.find_positions(contours)
+    if self.normalized:
+      positions = normalized_positions
+    return positions.take([m-1 for m in self.modes], axis=1)
+
 class _ImageMeasurementBase(object):
   def __init__(self, image_type, contour_match, image_names):
     self.image_type = image_type
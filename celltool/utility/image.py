@@ -39,21 +39,44 @@ def _conv_type_shape(im):
         return shape+(extra,), typ
 
 
-def read_array_from_image_file(filename):
+# numpy types (and number of bands) of the raw pixel layouts in image files
+# that can be viewed directly in a memory-mapped file
+_RAW_CONV = {
+  "L": ('|u1', None),
+  "I;16": ('<u2', None),
+  "I;16B": ('>u2', None),
+  "I;16S": ('<i2', None),
+  "I;16BS": ('>i2', None),
+  "I;32S": ('<i4', None),
+  "I;32BS": ('>i4', None),
+  "F;32F": ('<f4', None),
+  "F;32BF": ('>f4', None),
+  "RGB": ('|u1', 3),
+  "RGBX": ('|u1', 4),
+  "RGBA": ('|u1', 4),
+  "CMYK": ('|u1', 4),
+}
+
+def read_array_from_image_file(filename, mmap = False):
   """Read an image from disk and return a numpy array corresponding to that image.
   
   The read-in image is suitably transformed so that pixel (x, y) of the image
   corresponds to array element [x,y]. (The normal __array_interface__ from PIL
   yields the transpose of the 'expected' array.)
+  
+  If 'mmap' is True and the pixels are stored uncompressed as consecutive whole
+  rows (as in uncompressed TIFF files written in strips, or in tiles as wide as
+  the image), a read-only array that maps the file into memory is returned:
+  opening the image is then nearly instant, and the file is read only where the
+  pixels are used. The dtype of the array is that of the pixels in the file,
+  including their byte order. Other images are read into memory as usual.
   """
   im = pil_lite.Image.open(filename)
-  shape, typestr = _conv_type_shape(im)
-  if im.mode == "1":
-    byte_array = numpy.fromstring(im.tostring(), dtype=numpy.uint8)
-    array = numpy.unpackbits(byte_array).astype(bool)
-  else:
-    array = numpy.fromstring(im.tostring(), dtype=typestr)
-  array = numpy.reshape(array, shape).swapaxes(1, 0)
+  array = None
+  if mmap:
+    array = _map_array(im)
+  if array is None:
+    array = _decode_array(im)
   if im.mode == 'P':
     # try to convert the paletted image to a color image
     if im.palette.mode != 'RGB':
@@ -62,6 +85,72 @@ def read_array_from_image_file(filename):
     array = make_color_array(*[numpy.take(p, array) for p in palette.transpose()]).astype(numpy.uint8)
   return array
 
+def _decode_array(im):
+  shape, typestr = _conv_type_shape(im)
+  # Decode straight into a numpy array laid out as PIL image memory, which
+  # has one byte (0 or 255) per pixel for bilevel images and four bytes per
+  # pixel for RGB images.
+  if im.mode == "1":
+    storage = numpy.empty(shape, dtype=numpy.uint8)
+  elif im.mode == "RGB":
+    storage = numpy.empty(shape[:2]+(4,), dtype=numpy.uint8)
+  else:
+    storage = numpy.empty(shape, dtype=typestr)
+  if im.load_into(storage, storage.strides[0]):
+    if im.mode == "1":
+      array = storage != 0
+    elif im.mode == "RGB":
+      array = storage[:,:,:3]
+    else:
+      array = storage
+  else:
+    # the loader for this format allocated its own image memory
+    if im.mode == "1":
+      byte_array = numpy.fromstring(im.tostring(), dtype=numpy.uint8)
+      array = numpy.unpackbits(byte_array).astype(bool)
+    else:
+      array = numpy.fromstring(im.tostring(), dtype=typestr)
+    array = numpy.reshape(array, shape)
+  return array.swapaxes(1, 0)
+
+def _map_array(im):
+  """Return a read-only array mapping the pixels of an image file that are
+  stored uncompressed in consecutive rows, or None if they are not."""
+  if not getattr(im, 'filename', None) or not im.tile or im.mode == 'P':
+    return None
+  width, height = im.size
+  codec, box, start, args = im.tile[0]
+  # raw tile arguments are usually (rawmode, stride, ystep), but some loaders
+  # give the rawmode alone
+  if (codec != "raw" or not isinstance(args, tuple) or len(args) != 3 or
+      not _RAW_CONV.has_key(args[0])):
+    return None
+  rawmode, stride, ystep = args
+  typestr, bands = _RAW_CONV[rawmode]
+  shape = (height, width)
+  if bands is not None:
+    shape += (bands,)
+  row_bytes = width * numpy.dtype(typestr).itemsize * (bands or 1)
+  if stride not in (0, row_bytes) or ystep not in (1, -1) or (ystep < 0 and
+      len(im.tile) > 1):
+    return None
+  # each tile must hold whole rows, continuing where the previous one ended
+  rows = 0
+  for codec, box, offset, tile_args in im.tile:
+    x0, y0, x1, y1 = box
+    if (codec != "raw" or not isinstance(tile_args, tuple) or
+        len(tile_args) != 3 or tile_args != args or x0 != 0 or x1 != width or
+        y0 != rows or offset != start + rows * row_bytes):
+      return None
+    rows = min(y1, height)
+  if rows != height:
+    return None
+  array = numpy.memmap(im.filename, dtype=typestr, mode='r', offset=start,
+    shape=shape)
+  if ystep < 0:
+    array = array[::-1]
+  return array.swapaxes(1, 0)
+
 def read_grayscale_array_from_image_file(filename, warn = True):
   """Read an image from disk into a 2-D grayscale array, converting from color if necessary.
   
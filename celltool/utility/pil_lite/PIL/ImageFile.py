@@ -69,6 +69,9 @@ class ImageFile(Image.Image):
         self.decoderconfig = ()
         self.decodermaxblock = MAXBLOCK
 
+        self.load_buffer = None
+        self.buffer_im = None
+
         if Image.isStringType(fp):
             # filename
             self.fp = open(fp, "rb")
@@ -126,7 +129,7 @@ class ImageFile(Image.Image):
 
         readonly = 0
 
-        if self.filename and len(self.tile) == 1:
+        if self.filename and len(self.tile) == 1 and not self.load_buffer:
             # try memory mapping
             d, e, o, a = self.tile[0]
             if d == "raw" and a[0] == self.mode and a[0] in Image._MAPMODES:
@@ -216,9 +219,33 @@ class ImageFile(Image.Image):
 
         return Image.Image.load(self)
 
+    def load_into(self, buffer, stride):
+        "Load image data directly into a writable buffer"
+
+        # The buffer (such as a numpy array) must be laid out as image
+        # memory: lines of 'stride' bytes, each holding one byte (modes
+        # "1", "L" and "P"), two bytes (mode "S") or four bytes (other
+        # modes) per pixel. The decoders then write straight into it.
+        # Returns false if the image was loaded into memory of its own
+        # instead (already loaded, or a loader that allocates its own).
+
+        self.load_buffer = buffer, stride
+        try:
+            self.load()
+        finally:
+            self.load_buffer = None
+        return self.im is not None and self.im is self.buffer_im
+
     def load_prepare(self):
+        # decode into the caller's buffer if one is given
+        if self.load_buffer:
+            buffer, stride = self.load_buffer
+            self.im = Image.core.map_buffer(
+                buffer, self.size, "raw", None, 0, (self.mode, stride, 1)
+                )
+            self.buffer_im = self.im
         # create image memory if necessary
-        if not self.im or\
+        elif not self.im or\
            self.im.mode != self.mode or self.im.size != self.size:
             self.im = Image.core.new(self.mode, self.size)
         # create palette (optional)
@@ -0,0 +1,93 @@
+# Copyright 2007 Zachary Pincus
+# This file is part of CellTool.
+#
+# CellTool is free software; you can redistribute it and/or modify
+# it under the terms of version 2 of the GNU General Public License as
+# published by the Free Software Foundation.
+
+"""Tools for spreading work across several processor cores.
+
+The numerically-intensive parts of CellTool are implemented in C and C++
+extension modules which release the Python global interpreter lock while they
+compute. Calling such functions from several Python threads at once thus puts
+several cores to work, without the overhead of separate processes.
+"""
+
+import os
+import sys
+import threading
+
+def cpu_count():
+  """Return the number of processors available on this machine, or 1 if this
+  cannot be determined."""
+  try:
+    count = int(os.sysconf('SC_NPROCESSORS_ONLN'))
+  except:
+    try:
+      count = int(os.environ['NUMBER_OF_PROCESSORS'])
+    except:
+      count = 1
+  return max(1, count)
+
+def thread_count(threads = None):
+  """Return the number of threads to use: 'threads' if it is given, otherwise
+  the number of processors."""
+  if threads is None:
+    return cpu_count()
+  return max(1, int(threads))
+
+def thread_map(function, items, threads = None):
+  """Return [function(item) for item in items], with the function calls
+  distributed over a pool of worker threads.
+
+  The items are consumed in order (so a progress_list from terminal_tools
+  will display progress correctly), and the results are returned in the same
+  order as the items. If 'threads' is None, one thread per processor is used;
+  if it is 1, everything is run in the calling thread. If any call raises an exception, the remaining items are abandoned
+  and the first such exception is re-raised in the calling thread.
+  """
+  threads = thread_count(threads)
+  if threads == 1:
+    return [function(item) for item in items]
+  items = iter(items)
+  results = {}
+  errors = []
+  lock = threading.Lock()
+  def worker():
+    while True:
+      lock.acquire()
+      try:
+        if errors:
+          return
+        try:
+          index = len(results)
+          item = items.next()
+          results[index] = None
+        except StopIteration:
+          return
+      finally:
+        lock.release()
+      try:
+        result = function(item)
+      except:
+        lock.acquire()
+        errors.append(sys.exc_info())
+        lock.release()
+        return
+      results[index] = result
+  workers = [threading.Thread(target=worker) for i in range(threads)]
+  for w in workers:
+    w.start()
+  for w in workers:
+    w.join()
+  if errors:
+    exc_type, value, traceback = errors[0]
+    raise exc_type, value, traceback
+  return [results[i] for i in range(len(results))]
+
+def partition(length, pieces):
+  """Divide range(length) into at most 'pieces' contiguous blocks of nearly
+  equal size. Returns a list of (start, stop) pairs."""
+  pieces = max(1, min(pieces, length))
+  bounds = [(length * i) // pieces for i in range(pieces + 1)]
+  return [(bounds[i], bounds[i+1]) for i in range(pieces) if bounds[i+1] > bounds[i]]